@@ -0,0 +1,135 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+// Bump allocator for the transient data of one request. Nothing is freed
+// individually; Reset() releases everything at once and keeps a single block
+// large enough for the next request of the same size.
+class McpArena
+{
+public:
+	McpArena(size_t block_size = 16 * 1024, size_t max_retained = 1024 * 1024)
+		: m_blocks()
+		, m_used(0)
+		, m_block_size(block_size)
+		, m_max_retained(max_retained)
+	{
+	}
+
+	~McpArena()
+	{
+		for (auto& block : m_blocks)
+		{
+			free(block.data);
+		}
+	}
+
+	McpArena(const McpArena&) = delete;
+	McpArena& operator=(const McpArena&) = delete;
+
+	void* Allocate(size_t size, size_t align = alignof(std::max_align_t))
+	{
+		if (!m_blocks.empty())
+		{
+			Block& block = m_blocks.back();
+			size_t offset = (m_used + align - 1) & ~(align - 1);
+			if (offset + size <= block.size)
+			{
+				m_used = offset + size;
+				return block.data + offset;
+			}
+		}
+
+		size_t block_size = m_blocks.empty() ? m_block_size : m_blocks.back().size * 2;
+		if (block_size < size + align)
+		{
+			block_size = size + align;
+		}
+		char* data = (char*)malloc(block_size);
+		if (data == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		m_blocks.push_back({ data, block_size });
+
+		size_t offset = ((size_t)data + align - 1) & ~(align - 1);
+		m_used = offset - (size_t)data + size;
+		return (char*)offset;
+	}
+
+	char* Duplicate(const char* buf, size_t len)
+	{
+		char* p = (char*)Allocate(len + 1, 1);
+		memcpy(p, buf, len);
+		p[len] = '\0';
+		return p;
+	}
+
+	char* Format(const char* fmt, ...)
+	{
+		va_list ap;
+		va_start(ap, fmt);
+		int len = vsnprintf(nullptr, 0, fmt, ap);
+		va_end(ap);
+		char* p = (char*)Allocate(len > 0 ? (size_t)len + 1 : 1, 1);
+		va_start(ap, fmt);
+		vsnprintf(p, len > 0 ? (size_t)len + 1 : 1, fmt, ap);
+		va_end(ap);
+		return p;
+	}
+
+	void Reset()
+	{
+		if (m_blocks.size() > 1)
+		{
+			size_t total = 0;
+			for (auto& block : m_blocks)
+			{
+				total += block.size;
+				free(block.data);
+			}
+			m_blocks.clear();
+			m_block_size = total < m_max_retained ? total : m_max_retained;
+		}
+		else if (!m_blocks.empty() && m_blocks[0].size > m_max_retained)
+		{
+			free(m_blocks[0].data);
+			m_blocks.clear();
+			m_block_size = m_max_retained;
+		}
+		m_used = 0;
+	}
+
+private:
+	struct Block {
+		char* data;
+		size_t size;
+	};
+	std::vector<Block> m_blocks;
+	size_t m_used;
+	size_t m_block_size;
+	size_t m_max_retained;
+};
@@ -0,0 +1,375 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "McpBase64.h"
+#include "McpCpu.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// The two alphabets differ only in the characters for 62 and 63
+struct McpBase64Table {
+	char c62;
+	char c63;
+	char chars[64];
+	signed char values[256];
+
+	McpBase64Table(char c62, char c63)
+		: c62(c62)
+		, c63(c63)
+	{
+		memcpy(chars, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 62);
+		chars[62] = c62;
+		chars[63] = c63;
+		memset(values, -1, sizeof(values));
+		for (int i = 0; i < 64; i++)
+		{
+			values[(unsigned char)chars[i]] = (signed char)i;
+		}
+	}
+};
+static const McpBase64Table s_tables[2] = { McpBase64Table('+', '/'), McpBase64Table('-', '_') };
+
+static void EncodeScalar(const unsigned char* in, size_t len, char* out, const McpBase64Table& table, bool pad)
+{
+	size_t i = 0;
+	for (; i + 3 <= len; i += 3)
+	{
+		uint32_t v = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+		out[0] = table.chars[v >> 18];
+		out[1] = table.chars[(v >> 12) & 0x3f];
+		out[2] = table.chars[(v >> 6) & 0x3f];
+		out[3] = table.chars[v & 0x3f];
+		out += 4;
+	}
+	if (i == len)
+	{
+		return;
+	}
+	uint32_t v = (uint32_t)in[i] << 16;
+	if (i + 1 < len)
+	{
+		v |= (uint32_t)in[i + 1] << 8;
+	}
+	*out++ = table.chars[v >> 18];
+	*out++ = table.chars[(v >> 12) & 0x3f];
+	if (i + 1 < len)
+	{
+		*out++ = table.chars[(v >> 6) & 0x3f];
+	}
+	else if (pad)
+	{
+		*out++ = '=';
+	}
+	if (pad)
+	{
+		*out++ = '=';
+	}
+}
+
+// len has no padding and is not 1 more than a multiple of 4
+static bool DecodeScalar(const unsigned char* in, size_t len, unsigned char* out, const McpBase64Table& table, size_t* out_len)
+{
+	unsigned char* o = out;
+	size_t i = 0;
+	for (; i + 4 <= len; i += 4)
+	{
+		int a = table.values[in[i]], b = table.values[in[i + 1]], c = table.values[in[i + 2]], d = table.values[in[i + 3]];
+		if ((a | b | c | d) < 0)
+		{
+			return false;
+		}
+		uint32_t v = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | (uint32_t)d;
+		*o++ = (unsigned char)(v >> 16);
+		*o++ = (unsigned char)(v >> 8);
+		*o++ = (unsigned char)v;
+	}
+	if (i < len)
+	{
+		int a = table.values[in[i]], b = table.values[in[i + 1]];
+		int c = i + 2 < len ? table.values[in[i + 2]] : 0;
+		if ((a | b | c) < 0)
+		{
+			return false;
+		}
+		uint32_t v = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6);
+		*o++ = (unsigned char)(v >> 16);
+		if (i + 2 < len)
+		{
+			*o++ = (unsigned char)(v >> 8);
+		}
+	}
+	*out_len = (size_t)(o - out);
+	return true;
+}
+
+// The block functions convert as many whole blocks as they can and return
+// the input consumed; the scalar code finishes the rest. A decode block with
+// an invalid character is left to the scalar code to reject.
+typedef size_t (*EncodeBlocksFunc)(const unsigned char* in, size_t len, char* out, const McpBase64Table& table);
+typedef size_t (*DecodeBlocksFunc)(const unsigned char* in, size_t len, unsigned char* out, const McpBase64Table& table);
+
+static size_t EncodeBlocksScalar(const unsigned char*, size_t, char*, const McpBase64Table&)
+{
+	return 0;
+}
+
+static size_t DecodeBlocksScalar(const unsigned char*, size_t, unsigned char*, const McpBase64Table&)
+{
+	return 0;
+}
+
+#if defined(MCP_CPU_X86)
+// Encoding follows Mula's method: a byte shuffle puts each 3-byte group in
+// a 32-bit lane as b1 b0 b2 b1, and two 16-bit multiplies move the four
+// 6-bit fields into separate bytes. The fields are then mapped to ASCII by
+// adding a per-range offset. Decoding subtracts the offsets again and packs
+// the fields with two multiply-adds.
+
+// Offset from a 6-bit value to its character: 'A' for 0-25, then one step
+// for 26, 52, 62 and 63
+static inline __m128i EncodeMapSse(__m128i index, const McpBase64Table& table)
+{
+	__m128i shift = _mm_set1_epi8('A');
+	shift = _mm_add_epi8(shift, _mm_and_si128(_mm_cmpgt_epi8(index, _mm_set1_epi8(25)), _mm_set1_epi8('a' - 26 - 'A')));
+	shift = _mm_add_epi8(shift, _mm_and_si128(_mm_cmpgt_epi8(index, _mm_set1_epi8(51)), _mm_set1_epi8('0' - 52 - ('a' - 26))));
+	shift = _mm_add_epi8(shift, _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8(62)), _mm_set1_epi8((char)(table.c62 - 62 - ('0' - 52)))));
+	shift = _mm_add_epi8(shift, _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8(63)), _mm_set1_epi8((char)(table.c63 - 63 - ('0' - 52)))));
+	return _mm_add_epi8(index, shift);
+}
+
+// c - lo <= hi - lo unsigned is max(c - lo, hi - lo) == hi - lo
+static inline __m128i InRangeSse(__m128i c, char lo, char hi)
+{
+	__m128i span = _mm_set1_epi8((char)(hi - lo));
+	return _mm_cmpeq_epi8(_mm_max_epu8(_mm_sub_epi8(c, _mm_set1_epi8(lo)), span), span);
+}
+
+MCP_TARGET_SSSE3 static size_t EncodeBlocksSsse3(const unsigned char* in, size_t len, char* out, const McpBase64Table& table)
+{
+	const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	size_t i = 0;
+	// 12 bytes are used of each 16 loaded
+	for (; i + 16 <= len; i += 12)
+	{
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + i)), shuffle);
+		__m128i hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+		__m128i lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+		_mm_storeu_si128((__m128i*)(out + i / 3 * 4), EncodeMapSse(_mm_or_si128(hi, lo), table));
+	}
+	return i;
+}
+
+MCP_TARGET_SSSE3 static size_t DecodeBlocksSsse3(const unsigned char* in, size_t len, unsigned char* out, const McpBase64Table& table)
+{
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i upper = InRangeSse(c, 'A', 'Z');
+		__m128i lower = InRangeSse(c, 'a', 'z');
+		__m128i digit = InRangeSse(c, '0', '9');
+		__m128i is62 = _mm_cmpeq_epi8(c, _mm_set1_epi8(table.c62));
+		__m128i is63 = _mm_cmpeq_epi8(c, _mm_set1_epi8(table.c63));
+		__m128i valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), digit), _mm_or_si128(is62, is63));
+		if (_mm_movemask_epi8(valid) != 0xffff)
+		{
+			break;
+		}
+		__m128i shift = _mm_or_si128(
+			_mm_or_si128(
+				_mm_and_si128(upper, _mm_set1_epi8((char)-'A')),
+				_mm_and_si128(lower, _mm_set1_epi8((char)(26 - 'a')))
+			),
+			_mm_or_si128(
+				_mm_and_si128(digit, _mm_set1_epi8((char)(52 - '0'))),
+				_mm_or_si128(
+					_mm_and_si128(is62, _mm_set1_epi8((char)(62 - table.c62))),
+					_mm_and_si128(is63, _mm_set1_epi8((char)(63 - table.c63)))
+				)
+			)
+		);
+		__m128i v = _mm_add_epi8(c, shift);
+		// a b c d -> (a << 6 | b) and (c << 6 | d) -> 24 bits per lane
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		unsigned char* o = out + i / 4 * 3;
+		_mm_storel_epi64((__m128i*)o, v);
+		uint32_t rest = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+		memcpy(o + 8, &rest, 4);
+	}
+	return i;
+}
+
+MCP_TARGET_AVX2 static inline __m256i EncodeMapAvx2(__m256i index, const McpBase64Table& table)
+{
+	__m256i shift = _mm256_set1_epi8('A');
+	shift = _mm256_add_epi8(shift, _mm256_and_si256(_mm256_cmpgt_epi8(index, _mm256_set1_epi8(25)), _mm256_set1_epi8('a' - 26 - 'A')));
+	shift = _mm256_add_epi8(shift, _mm256_and_si256(_mm256_cmpgt_epi8(index, _mm256_set1_epi8(51)), _mm256_set1_epi8('0' - 52 - ('a' - 26))));
+	shift = _mm256_add_epi8(shift, _mm256_and_si256(_mm256_cmpeq_epi8(index, _mm256_set1_epi8(62)), _mm256_set1_epi8((char)(table.c62 - 62 - ('0' - 52)))));
+	shift = _mm256_add_epi8(shift, _mm256_and_si256(_mm256_cmpeq_epi8(index, _mm256_set1_epi8(63)), _mm256_set1_epi8((char)(table.c63 - 63 - ('0' - 52)))));
+	return _mm256_add_epi8(index, shift);
+}
+
+MCP_TARGET_AVX2 static inline __m256i InRangeAvx2(__m256i c, char lo, char hi)
+{
+	__m256i span = _mm256_set1_epi8((char)(hi - lo));
+	return _mm256_cmpeq_epi8(_mm256_max_epu8(_mm256_sub_epi8(c, _mm256_set1_epi8(lo)), span), span);
+}
+
+MCP_TARGET_AVX2 static size_t EncodeBlocksAvx2(const unsigned char* in, size_t len, char* out, const McpBase64Table& table)
+{
+	const __m256i shuffle = _mm256_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+	);
+	size_t i = 0;
+	// Each 128-bit lane takes 12 bytes, loaded 16 at a time
+	for (; i + 28 <= len; i += 24)
+	{
+		__m256i v = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + i))),
+			_mm_loadu_si128((const __m128i*)(in + i + 12)),
+			1
+		);
+		v = _mm256_shuffle_epi8(v, shuffle);
+		__m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+		__m256i lo = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+		_mm256_storeu_si256((__m256i*)(out + i / 3 * 4), EncodeMapAvx2(_mm256_or_si256(hi, lo), table));
+	}
+	return i + EncodeBlocksSsse3(in + i, len - i, out + i / 3 * 4, table);
+}
+
+MCP_TARGET_AVX2 static size_t DecodeBlocksAvx2(const unsigned char* in, size_t len, unsigned char* out, const McpBase64Table& table)
+{
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+	);
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i c = _mm256_loadu_si256((const __m256i*)(in + i));
+		__m256i upper = InRangeAvx2(c, 'A', 'Z');
+		__m256i lower = InRangeAvx2(c, 'a', 'z');
+		__m256i digit = InRangeAvx2(c, '0', '9');
+		__m256i is62 = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(table.c62));
+		__m256i is63 = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(table.c63));
+		__m256i valid = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(upper, lower), digit), _mm256_or_si256(is62, is63));
+		if ((unsigned)_mm256_movemask_epi8(valid) != 0xffffffffu)
+		{
+			break;
+		}
+		__m256i shift = _mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_and_si256(upper, _mm256_set1_epi8((char)-'A')),
+				_mm256_and_si256(lower, _mm256_set1_epi8((char)(26 - 'a')))
+			),
+			_mm256_or_si256(
+				_mm256_and_si256(digit, _mm256_set1_epi8((char)(52 - '0'))),
+				_mm256_or_si256(
+					_mm256_and_si256(is62, _mm256_set1_epi8((char)(62 - table.c62))),
+					_mm256_and_si256(is63, _mm256_set1_epi8((char)(63 - table.c63)))
+				)
+			)
+		);
+		__m256i v = _mm256_add_epi8(c, shift);
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, pack);
+		// 12 bytes at the start of each lane; close the gap between them
+		v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		unsigned char* o = out + i / 4 * 3;
+		_mm_storeu_si128((__m128i*)o, _mm256_castsi256_si128(v));
+		_mm_storel_epi64((__m128i*)(o + 16), _mm256_extracti128_si256(v, 1));
+	}
+	return i + DecodeBlocksSsse3(in + i, len - i, out + i / 4 * 3, table);
+}
+#endif
+
+static EncodeBlocksFunc SelectEncodeBlocks()
+{
+#if defined(MCP_CPU_X86)
+	if (getenv("MCP_BASE64_SCALAR") == nullptr)
+	{
+		if (McpCpu().avx2)
+		{
+			return EncodeBlocksAvx2;
+		}
+		if (McpCpu().ssse3)
+		{
+			return EncodeBlocksSsse3;
+		}
+	}
+#endif
+	return EncodeBlocksScalar;
+}
+
+static DecodeBlocksFunc SelectDecodeBlocks()
+{
+#if defined(MCP_CPU_X86)
+	if (getenv("MCP_BASE64_SCALAR") == nullptr)
+	{
+		if (McpCpu().avx2)
+		{
+			return DecodeBlocksAvx2;
+		}
+		if (McpCpu().ssse3)
+		{
+			return DecodeBlocksSsse3;
+		}
+	}
+#endif
+	return DecodeBlocksScalar;
+}
+
+static const EncodeBlocksFunc s_encode_blocks = SelectEncodeBlocks();
+static const DecodeBlocksFunc s_decode_blocks = SelectDecodeBlocks();
+
+void McpBase64::Encode(const void* data, size_t len, char* out, Alphabet alphabet, bool pad)
+{
+	const McpBase64Table& table = s_tables[alphabet];
+	const unsigned char* in = (const unsigned char*)data;
+	size_t done = s_encode_blocks(in, len, out, table);
+	EncodeScalar(in + done, len - done, out + done / 3 * 4, table, pad);
+}
+
+bool McpBase64::Decode(std::string_view in, void* out, size_t* out_len, Alphabet alphabet)
+{
+	const McpBase64Table& table = s_tables[alphabet];
+	const unsigned char* p = (const unsigned char*)in.data();
+	size_t len = in.size();
+	if (alphabet == BASE64 && len > 0 && len % 4 == 0 && p[len - 1] == '=')
+	{
+		len -= p[len - 2] == '=' ? 2 : 1;
+	}
+	if (len % 4 == 1)
+	{
+		return false;
+	}
+	unsigned char* o = (unsigned char*)out;
+	size_t done = s_decode_blocks(p, len, o, table);
+	size_t tail_len;
+	if (!DecodeScalar(p + done, len - done, o + done / 4 * 3, table, &tail_len))
+	{
+		return false;
+	}
+	*out_len = done / 4 * 3 + tail_len;
+	return true;
+}
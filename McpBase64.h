@@ -0,0 +1,49 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Base64 (RFC 4648 section 4) and base64url (section 5). Blocks of 24 or
+// 12 input bytes go through AVX2 or SSSE3 when the CPU has them; the rest
+// is done a quantum at a time.
+class McpBase64
+{
+public:
+	enum Alphabet {
+		BASE64,
+		BASE64URL
+	};
+
+	static size_t EncodedSize(size_t len, bool pad)
+	{
+		return pad ? (len + 2) / 3 * 4 : (len * 4 + 2) / 3;
+	}
+	static size_t DecodedSizeLimit(size_t len)
+	{
+		return len / 4 * 3 + 2;
+	}
+
+	// Writes EncodedSize(len, pad) characters
+	static void Encode(const void* data, size_t len, char* out, Alphabet alphabet, bool pad);
+
+	// Padding is accepted for BASE64 only. out needs DecodedSizeLimit()
+	// bytes; false if the input has a character outside the alphabet.
+	static bool Decode(std::string_view in, void* out, size_t* out_len, Alphabet alphabet);
+};
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Runtime checks for the instruction set extensions the SIMD paths use.
+// SSE2 is part of x64 and is assumed on x86. Functions using more are
+// marked with MCP_TARGET_* so the rest of the file keeps the baseline.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MCP_CPU_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MCP_TARGET_SSSE3
+#define MCP_TARGET_AVX2
+#define MCP_TARGET_SHA
+#else
+#include <cpuid.h>
+#define MCP_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define MCP_TARGET_AVX2 __attribute__((target("avx2")))
+#define MCP_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#endif
+
+struct McpCpuFeatures {
+	bool ssse3;
+	bool avx2;
+	// SHA extensions along with the SSE4.1 blends that go with them
+	bool sha;
+
+	McpCpuFeatures()
+		: ssse3(false)
+		, avx2(false)
+		, sha(false)
+	{
+		int info[4];
+		Cpuid(info, 0);
+		int max_leaf = info[0];
+		Cpuid(info, 1);
+		ssse3 = (info[2] & (1 << 9)) != 0;
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		// OSXSAVE and AVX, then the OS must have enabled the YMM state
+		bool ymm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (GetXcr0() & 6) == 6;
+		if (max_leaf >= 7)
+		{
+			Cpuid(info, 7);
+			avx2 = ymm && (info[1] & (1 << 5)) != 0;
+			sha = sse41 && (info[1] & (1 << 29)) != 0;
+		}
+	}
+
+private:
+	static void Cpuid(int info[4], int leaf)
+	{
+#if defined(_MSC_VER)
+		__cpuidex(info, leaf, 0);
+#else
+		unsigned a, b, c, d;
+		__cpuid_count(leaf, 0, a, b, c, d);
+		info[0] = (int)a;
+		info[1] = (int)b;
+		info[2] = (int)c;
+		info[3] = (int)d;
+#endif
+	}
+	static unsigned long long GetXcr0()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned eax, edx;
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((unsigned long long)edx << 32) | eax;
+#endif
+	}
+};
+
+inline const McpCpuFeatures& McpCpu()
+{
+	static const McpCpuFeatures features;
+	return features;
+}
+#endif
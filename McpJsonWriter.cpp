@@ -0,0 +1,274 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "McpJsonWriter.h"
+#include "McpBase64.h"
+#include "McpCpu.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(MCP_CPU_X86)
+#define MCP_JSON_SIMD
+#if defined(_MSC_VER)
+static unsigned CountTrailingZeros(unsigned mask)
+{
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (unsigned)index;
+}
+#else
+static unsigned CountTrailingZeros(unsigned mask)
+{
+	return (unsigned)__builtin_ctz(mask);
+}
+#endif
+#endif
+
+// Replacement text for every byte that needs escaping, at depth 1 and at
+// depth 2 (the depth 1 sequence escaped once more). Bytes that need no
+// escaping have an empty entry.
+struct McpEscapeTable {
+	char seq[2][256][16];
+	unsigned char len[2][256];
+
+	McpEscapeTable()
+	{
+		static const char hex[] = "0123456789abcdef";
+		memset(seq, 0, sizeof(seq));
+		memset(len, 0, sizeof(len));
+		for (int c = 0; c < 256; c++)
+		{
+			char* p = seq[0][c];
+			switch (c) {
+			case '"': strcpy(p, "\\\""); break;
+			case '\\': strcpy(p, "\\\\"); break;
+			case '\b': strcpy(p, "\\b"); break;
+			case '\f': strcpy(p, "\\f"); break;
+			case '\n': strcpy(p, "\\n"); break;
+			case '\r': strcpy(p, "\\r"); break;
+			case '\t': strcpy(p, "\\t"); break;
+			default:
+				if (c < 0x20)
+				{
+					p[0] = '\\';
+					p[1] = 'u';
+					p[2] = '0';
+					p[3] = '0';
+					p[4] = hex[c >> 4];
+					p[5] = hex[c & 0x0f];
+				}
+				break;
+			}
+			len[0][c] = (unsigned char)strlen(p);
+		}
+		for (int c = 0; c < 256; c++)
+		{
+			char* p = seq[1][c];
+			for (const char* q = seq[0][c]; *q != '\0'; q++)
+			{
+				const char* again = seq[0][(unsigned char)*q];
+				if (*again != '\0')
+				{
+					strcpy(p, again);
+					p += strlen(again);
+				}
+				else
+				{
+					*p++ = *q;
+				}
+			}
+			*p = '\0';
+			len[1][c] = (unsigned char)strlen(seq[1][c]);
+		}
+	}
+};
+static const McpEscapeTable s_escape;
+
+// Returns the length of the leading run of bytes that need no escaping,
+// i.e. the offset of the first quote, backslash or control byte
+static size_t FindEscapeScalar(const unsigned char* p, size_t len)
+{
+	size_t i = 0;
+	while (i < len && s_escape.len[0][p[i]] == 0)
+	{
+		i++;
+	}
+	return i;
+}
+
+#if defined(MCP_JSON_SIMD)
+static size_t FindEscapeSse2(const unsigned char* p, size_t len)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1f);
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		// v <= 0x1f unsigned is max(v, 0x1f) == 0x1f
+		__m128i hit = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+			_mm_cmpeq_epi8(_mm_max_epu8(v, control), control)
+		);
+		unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+		if (mask != 0)
+		{
+			return i + CountTrailingZeros(mask);
+		}
+	}
+	return i + FindEscapeScalar(p + i, len - i);
+}
+
+MCP_TARGET_AVX2 static size_t FindEscapeAvx2(const unsigned char* p, size_t len)
+{
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i control = _mm256_set1_epi8(0x1f);
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+		__m256i hit = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+			_mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control)
+		);
+		unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+		if (mask != 0)
+		{
+			return i + CountTrailingZeros(mask);
+		}
+	}
+	return i + FindEscapeSse2(p + i, len - i);
+}
+#endif
+
+typedef size_t (*FindEscapeFunc)(const unsigned char* p, size_t len);
+
+static FindEscapeFunc SelectFindEscape()
+{
+#if defined(MCP_JSON_SIMD)
+	if (getenv("MCP_JSON_SCALAR") != nullptr)
+	{
+		return FindEscapeScalar;
+	}
+	return McpCpu().avx2 ? FindEscapeAvx2 : FindEscapeSse2;
+#else
+	return FindEscapeScalar;
+#endif
+}
+static const FindEscapeFunc s_find_escape = SelectFindEscape();
+
+char* McpJsonWriter::Reserve(size_t len)
+{
+	if (m_io->len + len > m_io->size)
+	{
+		if (!mg_iobuf_resize(m_io, mg_iobuf_grow_size(m_io, m_io->len + len)))
+		{
+			throw std::bad_alloc();
+		}
+	}
+	return (char*)m_io->buf + m_io->len;
+}
+
+void McpJsonWriter::Raw(const char* buf, size_t len)
+{
+	if (len == 0)
+	{
+		return;
+	}
+	memcpy(Reserve(len), buf, len);
+	m_io->len += len;
+}
+
+void McpJsonWriter::String(std::string_view str, int depth)
+{
+	if (depth > 1)
+	{
+		Raw("\\\"", 2);
+		Escape(str, depth);
+		Raw("\\\"", 2);
+	}
+	else
+	{
+		Raw("\"", 1);
+		Escape(str, depth);
+		Raw("\"", 1);
+	}
+}
+
+void McpJsonWriter::Escape(std::string_view str, int depth)
+{
+	int table = depth > 1 ? 1 : 0;
+	const char* p = str.data();
+	const char* end = p + str.size();
+	while (p < end)
+	{
+		// Copy the run of bytes that need no escaping in one go
+		size_t run = s_find_escape((const unsigned char*)p, (size_t)(end - p));
+		Raw(p, run);
+		p += run;
+		if (p == end)
+		{
+			break;
+		}
+		unsigned char c = (unsigned char)*p++;
+		Raw(s_escape.seq[table][c], s_escape.len[table][c]);
+	}
+}
+
+void McpJsonWriter::Base64(const void* data, size_t len)
+{
+	size_t encoded = McpBase64::EncodedSize(len, true);
+	McpBase64::Encode(data, len, Reserve(encoded), McpBase64::BASE64, true);
+	m_io->len += encoded;
+}
+
+void McpJsonWriter::Integer(int64_t value)
+{
+	char* p = Reserve(24);
+	std::to_chars_result result = std::to_chars(p, p + 24, value);
+	m_io->len += (size_t)(result.ptr - p);
+}
+
+void McpJsonWriter::Number(double value)
+{
+	if (!std::isfinite(value))
+	{
+		Raw("null", 4);
+		return;
+	}
+	char* p = Reserve(32);
+	std::to_chars_result result = std::to_chars(p, p + 32, value);
+	m_io->len += (size_t)(result.ptr - p);
+}
+
+void McpJsonWriter::Bool(bool value)
+{
+	if (value)
+	{
+		Raw("true", 4);
+	}
+	else
+	{
+		Raw("false", 5);
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "mongoose.h"
+
+#include <cstdint>
+#include <string_view>
+
+// Appends JSON straight into an mg_iobuf, typically the connection's send
+// buffer, so a reply is written once. Escape depth 1 is the content of a
+// JSON string; depth 2 is a string inside a JSON document that is itself
+// the content of a string, as used by the text mirror of structured output.
+class McpJsonWriter
+{
+public:
+	explicit McpJsonWriter(struct mg_iobuf* io)
+		: m_io(io)
+	{
+	}
+
+	void Raw(const char* buf, size_t len);
+	void Raw(std::string_view str)
+	{
+		Raw(str.data(), str.size());
+	}
+
+	// Quoted string; at depth 2 the quotes themselves are written escaped
+	void String(std::string_view str, int depth = 1);
+	void Escape(std::string_view str, int depth = 1);
+
+	// Padded base64 of binary data, which needs no escaping
+	void Base64(const void* data, size_t len);
+	void Integer(int64_t value);
+	void Number(double value);
+	void Bool(bool value);
+
+	size_t Size() const
+	{
+		return m_io->len;
+	}
+
+private:
+	char* Reserve(size_t len);
+
+	struct mg_iobuf* m_io;
+};
@@ -0,0 +1,491 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "McpJwt.h"
+#include "McpBase64.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Nesting allowed in claims the scanner skips
+static const int MAX_DEPTH = 32;
+
+static char* SkipSpace(char* p, char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+	{
+		p++;
+	}
+	return p;
+}
+
+static int HexDigit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static bool ReadHex4(const char* p, const char* end, uint32_t* value)
+{
+	if (end - p < 4)
+	{
+		return false;
+	}
+	uint32_t v = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		int digit = HexDigit(p[i]);
+		if (digit < 0)
+		{
+			return false;
+		}
+		v = (v << 4) | (uint32_t)digit;
+	}
+	*value = v;
+	return true;
+}
+
+// Reads the string starting at the quote *p points to and unescapes it in
+// place; an escape sequence is never shorter than what it stands for.
+// *p is left after the closing quote.
+static bool ReadString(char** p, char* end, std::string_view* str)
+{
+	char* r = *p + 1;
+	char* start = r;
+	char* w = r;
+	while (true)
+	{
+		if (r == end)
+		{
+			return false;
+		}
+		char c = *r;
+		if (c == '"')
+		{
+			break;
+		}
+		if ((unsigned char)c < 0x20)
+		{
+			return false;
+		}
+		if (c != '\\')
+		{
+			*w++ = *r++;
+			continue;
+		}
+		if (end - r < 2)
+		{
+			return false;
+		}
+		switch (r[1]) {
+		case '"': *w++ = '"'; break;
+		case '\\': *w++ = '\\'; break;
+		case '/': *w++ = '/'; break;
+		case 'b': *w++ = '\b'; break;
+		case 'f': *w++ = '\f'; break;
+		case 'n': *w++ = '\n'; break;
+		case 'r': *w++ = '\r'; break;
+		case 't': *w++ = '\t'; break;
+		case 'u':
+		{
+			uint32_t cp;
+			if (!ReadHex4(r + 2, end, &cp))
+			{
+				return false;
+			}
+			r += 6;
+			if (cp >= 0xd800 && cp < 0xdc00)
+			{
+				uint32_t low;
+				if (end - r < 2 || r[0] != '\\' || r[1] != 'u' || !ReadHex4(r + 2, end, &low) || low < 0xdc00 || low >= 0xe000)
+				{
+					return false;
+				}
+				cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+				r += 6;
+			}
+			else if (cp >= 0xdc00 && cp < 0xe000)
+			{
+				return false;
+			}
+			if (cp < 0x80)
+			{
+				*w++ = (char)cp;
+			}
+			else if (cp < 0x800)
+			{
+				*w++ = (char)(0xc0 | (cp >> 6));
+				*w++ = (char)(0x80 | (cp & 0x3f));
+			}
+			else if (cp < 0x10000)
+			{
+				*w++ = (char)(0xe0 | (cp >> 12));
+				*w++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+				*w++ = (char)(0x80 | (cp & 0x3f));
+			}
+			else
+			{
+				*w++ = (char)(0xf0 | (cp >> 18));
+				*w++ = (char)(0x80 | ((cp >> 12) & 0x3f));
+				*w++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+				*w++ = (char)(0x80 | (cp & 0x3f));
+			}
+			continue;
+		}
+		default:
+			return false;
+		}
+		r += 2;
+	}
+	*str = std::string_view(start, (size_t)(w - start));
+	*p = r + 1;
+	return true;
+}
+
+// NumericDate claims; a fraction of a second is truncated
+static bool ReadNumber(char** p, char* end, int64_t* value)
+{
+	double number;
+	std::from_chars_result result = std::from_chars(*p, end, number);
+	if (result.ec != std::errc() || !std::isfinite(number) || number < -9.2e18 || number > 9.2e18)
+	{
+		return false;
+	}
+	*value = (int64_t)number;
+	*p = (char*)result.ptr;
+	return true;
+}
+
+static bool SkipValue(char** p, char* end, int depth)
+{
+	char* q = SkipSpace(*p, end);
+	if (q == end)
+	{
+		return false;
+	}
+	if (*q == '"')
+	{
+		std::string_view ignored;
+		*p = q;
+		return ReadString(p, end, &ignored);
+	}
+	if (*q == '{' || *q == '[')
+	{
+		if (depth >= MAX_DEPTH)
+		{
+			return false;
+		}
+		char close = *q == '{' ? '}' : ']';
+		q = SkipSpace(q + 1, end);
+		if (q < end && *q == close)
+		{
+			*p = q + 1;
+			return true;
+		}
+		while (true)
+		{
+			if (close == '}')
+			{
+				std::string_view key;
+				if (q == end || *q != '"' || !ReadString(&q, end, &key))
+				{
+					return false;
+				}
+				q = SkipSpace(q, end);
+				if (q == end || *q != ':')
+				{
+					return false;
+				}
+				q++;
+			}
+			if (!SkipValue(&q, end, depth + 1))
+			{
+				return false;
+			}
+			q = SkipSpace(q, end);
+			if (q == end)
+			{
+				return false;
+			}
+			if (*q == close)
+			{
+				*p = q + 1;
+				return true;
+			}
+			if (*q != ',')
+			{
+				return false;
+			}
+			q = SkipSpace(q + 1, end);
+		}
+	}
+	// Number or literal: runs up to the next delimiter
+	char* start = q;
+	while (q < end && *q != ',' && *q != '}' && *q != ']' && *q != ' ' && *q != '\t' && *q != '\n' && *q != '\r')
+	{
+		q++;
+	}
+	if (q == start)
+	{
+		return false;
+	}
+	*p = q;
+	return true;
+}
+
+// Calls on_member(key, p) for every member of the top-level object with p
+// at the value; on_member either reads the value and advances p, or leaves
+// p alone to have the value skipped
+template <class OnMember>
+static bool ScanObject(char* p, char* end, OnMember on_member)
+{
+	p = SkipSpace(p, end);
+	if (p == end || *p != '{')
+	{
+		return false;
+	}
+	p = SkipSpace(p + 1, end);
+	if (p < end && *p == '}')
+	{
+		return SkipSpace(p + 1, end) == end;
+	}
+	while (true)
+	{
+		std::string_view key;
+		if (p == end || *p != '"' || !ReadString(&p, end, &key))
+		{
+			return false;
+		}
+		p = SkipSpace(p, end);
+		if (p == end || *p != ':')
+		{
+			return false;
+		}
+		p = SkipSpace(p + 1, end);
+		char* value = p;
+		if (!on_member(key, &p))
+		{
+			return false;
+		}
+		if (p == value && !SkipValue(&p, end, 1))
+		{
+			return false;
+		}
+		p = SkipSpace(p, end);
+		if (p == end)
+		{
+			return false;
+		}
+		if (*p == '}')
+		{
+			return SkipSpace(p + 1, end) == end;
+		}
+		if (*p != ',')
+		{
+			return false;
+		}
+		p = SkipSpace(p + 1, end);
+	}
+}
+
+static bool ReadStringMember(char** p, char* end, std::string_view* str)
+{
+	return *p < end && **p == '"' && ReadString(p, end, str);
+}
+
+static bool ReadNumberMember(char** p, char* end, int64_t* value, bool* present)
+{
+	if (!ReadNumber(p, end, value))
+	{
+		return false;
+	}
+	*present = true;
+	return true;
+}
+
+bool McpJwt::ScanHeader(char* p, char* end)
+{
+	return ScanObject(p, end, [this, end](std::string_view key, char** value) {
+		if (key == "alg")
+		{
+			return ReadStringMember(value, end, &m_alg);
+		}
+		if (key == "kid")
+		{
+			return ReadStringMember(value, end, &m_kid);
+		}
+		return true;
+	});
+}
+
+bool McpJwt::ScanPayload(char* p, char* end)
+{
+	return ScanObject(p, end, [this, end](std::string_view key, char** value) {
+		if (key == "aud")
+		{
+			// The audiences are packed '\0'-separated over the text of the
+			// value; every string shrinks by at least its quotes
+			char* out = *value;
+			char* q = *value;
+			if (q < end && *q == '"')
+			{
+				std::string_view aud;
+				if (!ReadString(&q, end, &aud))
+				{
+					return false;
+				}
+				if (aud.find('\0') != std::string_view::npos)
+				{
+					return false;
+				}
+				memmove(out, aud.data(), aud.size());
+				m_aud = std::string_view(out, aud.size());
+				*value = q;
+				return true;
+			}
+			if (q == end || *q != '[')
+			{
+				return false;
+			}
+			q = SkipSpace(q + 1, end);
+			char* w = out;
+			if (q < end && *q == ']')
+			{
+				m_aud = std::string_view();
+				*value = q + 1;
+				return true;
+			}
+			while (true)
+			{
+				std::string_view aud;
+				if (q == end || *q != '"' || !ReadString(&q, end, &aud) || aud.find('\0') != std::string_view::npos)
+				{
+					return false;
+				}
+				if (w != out)
+				{
+					*w++ = '\0';
+				}
+				memmove(w, aud.data(), aud.size());
+				w += aud.size();
+				q = SkipSpace(q, end);
+				if (q < end && *q == ']')
+				{
+					break;
+				}
+				if (q == end || *q != ',')
+				{
+					return false;
+				}
+				q = SkipSpace(q + 1, end);
+			}
+			m_aud = std::string_view(out, (size_t)(w - out));
+			*value = q + 1;
+			return true;
+		}
+		if (key == "iss")
+		{
+			m_has_iss = true;
+			return ReadStringMember(value, end, &m_iss);
+		}
+		if (key == "scope")
+		{
+			return ReadStringMember(value, end, &m_scope);
+		}
+		if (key == "exp")
+		{
+			return ReadNumberMember(value, end, &m_exp, &m_has_exp);
+		}
+		if (key == "nbf")
+		{
+			return ReadNumberMember(value, end, &m_nbf, &m_has_nbf);
+		}
+		if (key == "iat")
+		{
+			return ReadNumberMember(value, end, &m_iat, &m_has_iat);
+		}
+		return true;
+	});
+}
+
+bool McpJwt::Parse(std::string_view token)
+{
+	*this = McpJwt();
+
+	size_t dot1 = token.find('.');
+	if (dot1 == std::string_view::npos)
+	{
+		return false;
+	}
+	size_t dot2 = token.find('.', dot1 + 1);
+	if (dot2 == std::string_view::npos || token.find('.', dot2 + 1) != std::string_view::npos)
+	{
+		return false;
+	}
+
+	// Decoded data is never longer than its encoding
+	static thread_local std::vector<char> buffer;
+	if (buffer.size() < token.size())
+	{
+		buffer.resize(token.size());
+	}
+	char* header = buffer.data();
+	size_t header_len;
+	if (!McpBase64::Decode(token.substr(0, dot1), header, &header_len, McpBase64::BASE64URL))
+	{
+		return false;
+	}
+	char* payload = header + header_len;
+	size_t payload_len;
+	if (!McpBase64::Decode(token.substr(dot1 + 1, dot2 - dot1 - 1), payload, &payload_len, McpBase64::BASE64URL))
+	{
+		return false;
+	}
+	char* signature = payload + payload_len;
+	size_t signature_len;
+	if (!McpBase64::Decode(token.substr(dot2 + 1), signature, &signature_len, McpBase64::BASE64URL))
+	{
+		return false;
+	}
+
+	m_signing_input = token.substr(0, dot2);
+	m_signature = std::string_view(signature, signature_len);
+	return ScanHeader(header, header + header_len) && ScanPayload(payload, payload + payload_len);
+}
+
+bool McpJwt::HasAudience(std::string_view audience) const
+{
+	std::string_view rest = m_aud;
+	while (!rest.empty())
+	{
+		size_t end = rest.find('\0');
+		if (rest.substr(0, end) == audience)
+		{
+			return true;
+		}
+		if (end == std::string_view::npos)
+		{
+			break;
+		}
+		rest.remove_prefix(end + 1);
+	}
+	return false;
+}
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// A compact JWS token split into its parts, with only the claims the
+// server checks pulled out by one scan of the header and the payload; no
+// JSON tree is built. The decoded parts live in a buffer owned by the
+// calling thread, so the views stay valid until the next Parse() on the
+// same thread and an McpJwt must not be handed to another thread.
+class McpJwt
+{
+public:
+	McpJwt() = default;
+
+	// False if the token is not three base64url parts holding JSON objects,
+	// or a checked claim has the wrong type
+	bool Parse(std::string_view token);
+
+	std::string_view Algorithm() const { return m_alg; }
+	std::string_view KeyId() const { return m_kid; }
+	// "header.payload" as sent, which is what the signature covers
+	std::string_view SigningInput() const { return m_signing_input; }
+	std::string_view Signature() const { return m_signature; }
+
+	bool HasIssuer() const { return m_has_iss; }
+	std::string_view Issuer() const { return m_iss; }
+	std::string_view Scope() const { return m_scope; }
+	// "aud" may be one string or an array of them
+	bool HasAudience(std::string_view audience) const;
+
+	// Seconds since the epoch
+	bool HasExpiresAt() const { return m_has_exp; }
+	int64_t ExpiresAt() const { return m_exp; }
+	bool HasNotBefore() const { return m_has_nbf; }
+	int64_t NotBefore() const { return m_nbf; }
+	bool HasIssuedAt() const { return m_has_iat; }
+	int64_t IssuedAt() const { return m_iat; }
+
+private:
+	bool ScanHeader(char* p, char* end);
+	bool ScanPayload(char* p, char* end);
+
+	std::string_view m_alg;
+	std::string_view m_kid;
+	std::string_view m_signing_input;
+	std::string_view m_signature;
+	std::string_view m_iss;
+	std::string_view m_scope;
+	// Audiences separated by '\0'
+	std::string_view m_aud;
+	int64_t m_exp = 0;
+	int64_t m_nbf = 0;
+	int64_t m_iat = 0;
+	bool m_has_iss = false;
+	bool m_has_exp = false;
+	bool m_has_nbf = false;
+	bool m_has_iat = false;
+};
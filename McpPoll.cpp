@@ -0,0 +1,42 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "McpPoll.h"
+#include "mongoose.h"
+
+int McpPollTimeout(struct mg_mgr* mgr, int ms)
+{
+	uint64_t now = mg_millis();
+	for (struct mg_timer* timer = mgr->timers; timer != nullptr; timer = timer->next)
+	{
+		// A one-shot timer that has fired stays listed until it is freed,
+		// with an expiry mongoose keeps moving to now
+		if (!(timer->flags & MG_TIMER_REPEAT) && (timer->flags & MG_TIMER_CALLED))
+		{
+			continue;
+		}
+		if (timer->expire == 0 || timer->expire <= now)
+		{
+			return 0;
+		}
+		if (timer->expire - now < (uint64_t)ms)
+		{
+			ms = (int)(timer->expire - now);
+		}
+	}
+	return ms;
+}
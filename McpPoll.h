@@ -0,0 +1,26 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+struct mg_mgr;
+
+// How long mg_mgr_poll() may block: no longer than ms, and no longer than
+// until the earliest pending timer is due, so short sleeps are not rounded
+// up to the poll interval. One-shot timers that have already fired do not
+// count.
+int McpPollTimeout(struct mg_mgr* mgr, int ms);
@@ -18,19 +18,82 @@
 #define NOMINMAX
 
 #include "McpServer.h"
+#include "McpJsonWriter.h"
+#include "McpBase64.h"
+#include "McpJwt.h"
+#include "McpPoll.h"
+#include "McpSha256.h"
 #include "mongoose.h"
 #include "platform.h"
 
 #include "jwt-cpp/jwt.h"
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+
 typedef void (*mg_timer_handler_t)(void*);
-typedef void (*mg_rpc_handler_t)(struct mg_rpc_req*);
 
-static void mg_json_rpc2_vok(struct mg_rpc_req* r, const char* fmt, va_list* ap) {
+// Per-request state handed to the RPC handlers through mg_rpc_req::req_data.
+// The envelope members are slices of the request body located in one pass.
+struct McpRequest {
+	McpServer* server = nullptr;
+	void* loop = nullptr;
+	unsigned long connection_id = 0;
+	struct mg_str session_id = {};
+	bool deferred = false;
+	bool accepted = false;
+	struct mg_str jsonrpc = {};
+	struct mg_str id = {};
+	struct mg_str method = {};
+	struct mg_str params = {};
+};
+
+static void ParseEnvelope(struct mg_str body, McpRequest* req)
+{
+	struct mg_str key, val;
+	size_t ofs = 0;
+	while ((ofs = mg_json_next(body, ofs, &key, &val)) > 0)
+	{
+		if (mg_strcmp(key, mg_str("\"method\"")) == 0)
+		{
+			if (val.len >= 2 && val.buf[0] == '"')
+			{
+				req->method = mg_str_n(val.buf + 1, val.len - 2);
+			}
+		}
+		else if (mg_strcmp(key, mg_str("\"id\"")) == 0)
+		{
+			req->id = val;
+		}
+		else if (mg_strcmp(key, mg_str("\"params\"")) == 0)
+		{
+			req->params = val;
+		}
+		else if (mg_strcmp(key, mg_str("\"jsonrpc\"")) == 0)
+		{
+			req->jsonrpc = val;
+		}
+	}
+}
+
+static struct mg_str GetRequestId(struct mg_rpc_req* r)
+{
+	McpRequest* req = (McpRequest*)r->req_data;
+	if (req != nullptr)
+	{
+		return req->id;
+	}
 	int len, off = mg_json_get(r->frame, "$.id", &len);
-	if (off > 0) {
-		mg_xprintf(r->pfn, r->pfn_data, "event: message\ndata: {\"jsonrpc\":\"2.0\",%m:%.*s,%m:", mg_print_esc, 0, "id", len,
-			&r->frame.buf[off], mg_print_esc, 0, "result");
+	return off > 0 ? mg_str_n(&r->frame.buf[off], (size_t)len) : mg_str_n(nullptr, 0);
+}
+
+static void mg_json_rpc2_vok(struct mg_rpc_req* r, const char* fmt, va_list* ap) {
+	struct mg_str id = GetRequestId(r);
+	if (id.len > 0) {
+		mg_xprintf(r->pfn, r->pfn_data, "event: message\ndata: {\"jsonrpc\":\"2.0\",%m:%.*s,%m:", mg_print_esc, 0, "id", (int)id.len,
+			id.buf, mg_print_esc, 0, "result");
 		mg_vxprintf(r->pfn, r->pfn_data, fmt == NULL ? "null" : fmt, ap);
 		mg_xprintf(r->pfn, r->pfn_data, "}\n\n");
 	}
@@ -44,11 +107,11 @@ static void mg_json_rpc2_ok(struct mg_rpc_req* r, const char* fmt, ...) {
 }
 
 void mg_json_rpc2_verr(struct mg_rpc_req* r, int code, const char* fmt, va_list* ap) {
-	int len, off = mg_json_get(r->frame, "$.id", &len);
+	struct mg_str id = GetRequestId(r);
 	mg_xprintf(r->pfn, r->pfn_data, "event: message\ndata: {\"jsonrpc\":\"2.0\",");
-	if (off > 0) {
-		mg_xprintf(r->pfn, r->pfn_data, "%m:%.*s,", mg_print_esc, 0, "id", len,
-			&r->frame.buf[off]);
+	if (id.len > 0) {
+		mg_xprintf(r->pfn, r->pfn_data, "%m:%.*s,", mg_print_esc, 0, "id", (int)id.len,
+			id.buf);
 	}
 	mg_xprintf(r->pfn, r->pfn_data, "%m:{%m:%d,%m:", mg_print_esc, 0, "error",
 		mg_print_esc, 0, "code", code, mg_print_esc, 0, "message");
@@ -63,6 +126,146 @@ static void mg_json_rpc2_err(struct mg_rpc_req* r, int code, const char* fmt, ..
 	va_end(ap);
 }
 
+// Transient request data (names, argument strings, header lines and reply
+// scratch) lives in a per-thread arena that is reset once the reply is queued
+static thread_local McpArena s_arena;
+static thread_local int s_arena_depth = 0;
+
+// Only the outermost scope resets, so a reply completed synchronously from
+// inside a request does not release the request's own data
+struct McpArenaScope {
+	McpArenaScope()
+	{
+		s_arena_depth++;
+	}
+	~McpArenaScope()
+	{
+		if (--s_arena_depth == 0)
+		{
+			s_arena.Reset();
+		}
+	}
+};
+
+// Event loop run by the calling thread, if any
+static thread_local void* s_current_loop = nullptr;
+
+// mg_json_get_str() equivalent that allocates from the request arena
+static char* ArenaJsonStr(struct mg_str json, const char* path)
+{
+	int len = 0, off = mg_json_get(json, path, &len);
+	if (off < 0 || len < 2 || json.buf[off] != '"')
+	{
+		return nullptr;
+	}
+	char* result = (char*)s_arena.Allocate((size_t)len, 1);
+	if (!mg_json_unescape(mg_str_n(json.buf + off + 1, (size_t)(len - 2)), result, (size_t)len))
+	{
+		return nullptr;
+	}
+	return result;
+}
+
+// Worker reply buffers are recycled instead of being freed after every
+// request. A worker fills a buffer and the event loop releases it after
+// handing the bytes to the connection, so the pool is shared between threads.
+// Oversized buffers are released so the pool stays small.
+static const size_t REPLY_BUFFER_POOL_COUNT = 8;
+static const size_t REPLY_BUFFER_POOL_MAX_SIZE = 4 * 1024 * 1024;
+
+struct McpBufferPool {
+	std::mutex mutex;
+	std::vector<struct mg_iobuf> buffers;
+	~McpBufferPool()
+	{
+		for (auto& io : buffers)
+		{
+			mg_iobuf_free(&io);
+		}
+	}
+};
+static McpBufferPool s_buffer_pool;
+
+static struct mg_iobuf AcquireReplyBuffer()
+{
+	std::lock_guard<std::mutex> lock(s_buffer_pool.mutex);
+	if (!s_buffer_pool.buffers.empty())
+	{
+		struct mg_iobuf io = s_buffer_pool.buffers.back();
+		s_buffer_pool.buffers.pop_back();
+		io.len = 0;
+		return io;
+	}
+	struct mg_iobuf io = { 0, 0, 0, 1024, true };
+	return io;
+}
+
+static void ReleaseReplyBuffer(struct mg_iobuf* io)
+{
+	{
+		std::lock_guard<std::mutex> lock(s_buffer_pool.mutex);
+		if (io->buf != nullptr && io->size <= REPLY_BUFFER_POOL_MAX_SIZE && s_buffer_pool.buffers.size() < REPLY_BUFFER_POOL_COUNT)
+		{
+			s_buffer_pool.buffers.push_back(*io);
+			*io = { 0, 0, 0, 1024, true };
+			return;
+		}
+	}
+	mg_iobuf_free(io);
+	*io = { 0, 0, 0, 1024, true };
+}
+
+// Scratch space for structured tool output, kept per thread
+struct McpScratch {
+	struct mg_iobuf io = { 0, 0, 0, 1024, true };
+	~McpScratch()
+	{
+		mg_iobuf_free(&io);
+	}
+};
+static thread_local McpScratch s_rows;
+
+// Writes the status line and headers of an SSE reply with a blank
+// Content-Length, filled in by EndHttpReply() the way mg_http_reply() does.
+// Returns the offset of the body.
+static size_t BeginHttpReply(struct mg_iobuf* io, struct mg_str session_id)
+{
+	mg_xprintf(mg_pfn_iobuf, io,
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/event-stream\r\n"
+		"mcp-session-id: %.*s\r\n"
+		"Content-Length:            \r\n\r\n",
+		(int)session_id.len, session_id.buf
+	);
+	return io->len;
+}
+
+static void EndHttpReply(struct mg_iobuf* io, size_t body)
+{
+	size_t n = mg_snprintf((char*)&io->buf[body - 15], 11, "%-10lu", (unsigned long)(io->len - body));
+	io->buf[body - 15 + n] = ' ';
+}
+
+// Adds the mg_iobuf allocations and copies made on this thread while in scope
+struct McpBufferMeter {
+	std::atomic<uint64_t>& allocations;
+	std::atomic<uint64_t>& bytes_copied;
+	struct mg_iobuf_stats start;
+
+	McpBufferMeter(std::atomic<uint64_t>& allocations, std::atomic<uint64_t>& bytes_copied)
+		: allocations(allocations)
+		, bytes_copied(bytes_copied)
+		, start(*mg_iobuf_stats())
+	{
+	}
+	~McpBufferMeter()
+	{
+		struct mg_iobuf_stats* now = mg_iobuf_stats();
+		allocations += now->allocs - start.allocs;
+		bytes_copied += now->copied - start.copied;
+	}
+};
+
 McpServer::McpServer(const char* server_name)
 	: m_server_name(server_name)
 	, m_authorization(false)
@@ -71,11 +274,63 @@ McpServer::McpServer(const char* server_name)
 	, m_url()
 	, m_host()
 	, m_entry_point()
+	, m_tls_cert()
+	, m_tls_key()
+	, m_tls_shared(nullptr)
+	, m_tools_page_size(0)
+	, m_result_cache_mutex()
+	, m_result_cache()
+	, m_session_mutex()
 	, m_sessions()
-	, m_rpc_head(nullptr)
+	, m_session_event_buffer(64 * 1024)
+	, m_jwks_source()
+	, m_jwks_issuer()
+	, m_jwks_refresh_interval(0)
+	, m_jwks_ca()
+	, m_jwks_refreshing(false)
+	, m_key_set_mutex()
+	, m_key_set()
+	, m_token_cache()
+	, m_worker_threads(std::thread::hardware_concurrency() > 4 ? std::thread::hardware_concurrency() : 4)
+	, m_workers()
+	, m_job_mutex()
+	, m_job_cv()
+	, m_jobs()
+	, m_workers_stop(false)
+	, m_loops()
+	, m_cancel_mutex()
+	, m_cancellations()
+	, m_streaming_window(256 * 1024)
+	, m_progress_interval(100)
+	, m_geometric_connection_buffers(false)
+	, m_stat_requests(0)
+	, m_stat_allocations(0)
+	, m_stat_bytes_copied(0)
+	, m_stat_response_bytes(0)
 {
 }
 
+struct McpServer::McpProgress::State {
+	McpLoop* loop;
+	unsigned long connection_id;
+	std::string session_id;
+	// The progressToken as raw JSON, string or number
+	std::string token;
+	uint64_t interval;
+
+	std::mutex mutex;
+	double progress = 0;
+	double total = 0;
+	std::string message;
+	uint64_t last_sent = 0;
+	bool pending = false;
+	bool scheduled = false;
+	// The response headers went out and the reply is sent as chunks
+	bool started = false;
+	// The reply was sent or the connection closed
+	bool finished = false;
+};
+
 void McpServer::cbEvHander(void* connection, int event_code, void* event_data)
 {
 	mg_connection* conn = (mg_connection*)connection;
@@ -83,20 +338,80 @@ void McpServer::cbEvHander(void* connection, int event_code, void* event_data)
 
 	if (event_code == MG_EV_ACCEPT)
 	{
-		struct mg_tls_opts opts = 
-		{ 
-			.cert = mg_file_read(&mg_fs_posix, "cert.pem"),
-			.key = mg_file_read(&mg_fs_posix, "key.pem")
-		};
-		mg_tls_init(conn, &opts);
+		// Only an https listener has a certificate loaded
+		if (!self->m_tls_cert.empty())
+		{
+			struct mg_tls_opts opts =
+			{
+				.cert = mg_str_n(self->m_tls_cert.data(), self->m_tls_cert.size()),
+				.key = mg_str_n(self->m_tls_key.data(), self->m_tls_key.size()),
+				.shared = self->m_tls_shared
+			};
+			mg_tls_init(conn, &opts);
+		}
+		conn->send.geometric = conn->recv.geometric = self->m_geometric_connection_buffers;
+	}
+	else if (event_code == MG_EV_CLOSE)
+	{
+		// Detach a GET stream from its connection
+		McpLoop* loop = (McpLoop*)conn->mgr->userdata;
+		auto it = loop->attached.find(conn->id);
+		if (it != loop->attached.end())
+		{
+			McpEventStream& stream = *it->second;
+			{
+				std::lock_guard<std::mutex> lock(stream.mutex);
+				if (stream.connection_id == conn->id && stream.loop == loop)
+				{
+					stream.loop = nullptr;
+					stream.connection_id = 0;
+				}
+			}
+			loop->attached.erase(it);
+		}
+
+		EndProgress(loop, conn->id);
+
+		// A streaming tool learns that its client is gone from its next write
+		auto result = loop->results.find(conn->id);
+		if (result != loop->results.end())
+		{
+			McpResultStream* stream = result->second;
+			stream->m_connection = nullptr;
+			if (stream->m_waiting)
+			{
+				ResumeOnLoop(loop, std::exchange(stream->m_waiting, nullptr));
+			}
+			loop->results.erase(result);
+		}
+	}
+	else if (event_code == MG_EV_WRITE)
+	{
+		// Streaming window: resume the tool once half of it has drained
+		McpLoop* loop = (McpLoop*)conn->mgr->userdata;
+		if (!loop->results.empty())
+		{
+			auto result = loop->results.find(conn->id);
+			if (result != loop->results.end() && result->second->m_waiting && conn->send.len <= self->m_streaming_window / 2)
+			{
+				ResumeOnLoop(loop, std::exchange(result->second->m_waiting, nullptr));
+			}
+		}
+	}
+	else if (event_code == MG_EV_WAKEUP)
+	{
+		McpArenaScope arena_scope;
+		McpBufferMeter meter(self->m_stat_allocations, self->m_stat_bytes_copied);
+		FlushReplies((McpLoop*)conn->mgr->userdata);
 	}
 	else if (event_code == MG_EV_HTTP_MSG)
 	{
 		struct mg_http_message* hm = (struct mg_http_message*)event_data;
+		McpArenaScope arena_scope;
 		if (mg_match(hm->uri, mg_str(self->m_entry_point.data()), NULL)) 
 		{
-			std::string auth_token = "";
-			std::string session_id = "";
+			struct mg_str auth_token = mg_str_n(nullptr, 0);
+			struct mg_str session_id = mg_str_n("", 0);
 
 			mg_str authorization = mg_str_s("authorization");
 			mg_str mcp_session_id = mg_str_s("mcp-session-id");
@@ -108,116 +423,107 @@ void McpServer::cbEvHander(void* connection, int event_code, void* event_data)
 				}
 				if (mg_strcasecmp(hm->headers[i].name, authorization) == 0)
 				{
-					auth_token.assign(hm->headers[i].value.buf, hm->headers[i].value.len);
+					auth_token = hm->headers[i].value;
 				}
 				else if (mg_strcasecmp(hm->headers[i].name, mcp_session_id) == 0)
 				{
-					session_id.assign(hm->headers[i].value.buf, hm->headers[i].value.len);
+					session_id = hm->headers[i].value;
 				}
 			}
 
 			if (mg_strcasecmp(hm->method, mg_str("DELETE")) == 0)
 			{
 				mg_http_reply(conn, 200, "", "");
-				self->EraseSession(session_id);
+				self->EraseSession(std::string_view(session_id.buf, session_id.len));
 				return;
 			}
 			else if (mg_strcasecmp(hm->method, mg_str("GET")) == 0)
 			{
-				mg_http_reply(conn, 405, "", "");
+				if (!self->CheckAuthorization(conn, std::string_view(auth_token.buf, auth_token.len)))
+				{
+					return;
+				}
+				if (!self->IsEnableSessionId(std::string_view(session_id.buf, session_id.len)))
+				{
+					mg_http_reply(conn, 400, "", "");
+					return;
+				}
+				struct mg_str* last_event_id = mg_http_get_header(hm, "Last-Event-ID");
+				self->OpenEventStream(
+					conn,
+					std::string_view(session_id.buf, session_id.len),
+					last_event_id != nullptr ? std::string_view(last_event_id->buf, last_event_id->len) : std::string_view()
+				);
 				return;
 			}
 			else if (mg_strcasecmp(hm->method, mg_str("POST")) == 0)
 			{
-				if (self->m_authorization)
+				if (!self->CheckAuthorization(conn, std::string_view(auth_token.buf, auth_token.len)))
 				{
-					bool authorization_chk = false;
-
-					if (!auth_token.empty())
-					{
-						std::string::size_type aPos = auth_token.find_first_of("Bearer ");
-						if (aPos != std::string::npos)
-						{
-							std::string token = auth_token.substr(aPos + 7);
-							auto decoded = jwt::decode(token);
-							auto payload = decoded.get_payload_json();
-
-							std::string aud_value = payload["aud"].get<std::string>();
-							if (aud_value == self->m_url)
-							{
-								authorization_chk = true;
-							}
-						}
-					}
-
-					if (!authorization_chk)
-					{
-						std::string authenticate_header = "WWW-Authenticate: Bearer resource_metadata=\"";
-						authenticate_header += self->m_host;
-						authenticate_header += "/.well-known/oauth-protected-resource";
-						authenticate_header += self->m_entry_point;
-						authenticate_header += "\"\r\n";
-						mg_http_reply(
-							conn,
-							401,
-							authenticate_header.c_str(),
-							""
-						);
-						return;
-					}
+					return;
 				}
 
-				char* method = mg_json_get_str(hm->body, "$.method");
-				if (method != nullptr)
+				McpRequest req = { self, conn->mgr->userdata, conn->id, mg_str_n("", 0), false, false };
+				ParseEnvelope(hm->body, &req);
+				struct mg_str method = req.method;
+				if (method.buf != nullptr)
 				{
-					if (strcmp(method, "initialize") == 0)
+					if (mg_strcmp(method, mg_str("initialize")) == 0)
 					{
-						session_id = CreateSessionId();
+						std::string new_session_id = CreateSessionId();
+						session_id = mg_str_n(s_arena.Duplicate(new_session_id.data(), new_session_id.size()), new_session_id.size());
 					}
 					else
 					{
-						if (!self->IsEnableSessionId(session_id))
+						if (!self->IsEnableSessionId(std::string_view(session_id.buf, session_id.len)))
 						{
 							mg_http_reply(conn, 400, "", "");
 							return;
 						}
 					}
-					self->m_sessions[session_id] = 1;
+					self->TouchSession(std::string_view(session_id.buf, session_id.len));
 
-					if (strcmp(method, "notifications/initialized") == 0)
-					{
-						std::string headers = "mcp-session-id: " + session_id + "\r\n";
-						mg_http_reply(conn, 202, headers.c_str(), "");
-						return;
-					}
-					else if (strcmp(method, "notifications/cancelled") == 0)
-					{
-						std::string headers = "mcp-session-id: " + session_id + "\r\n";
-						mg_http_reply(conn, 202, headers.c_str(), "");
-						return;
-					}
+					McpBufferMeter meter(self->m_stat_allocations, self->m_stat_bytes_copied);
+					self->m_stat_requests++;
 
-					struct mg_rpc* s_rpc_head = (mg_rpc*)self->m_rpc_head;
-					struct mg_iobuf io = { 0, 0, 0, 1024 };
+					// The reply is written straight into the send buffer and
+					// rolled back if the method answers some other way
+					req.session_id = session_id;
+					struct mg_iobuf* io = &conn->send;
+					size_t mark = io->len;
+					size_t body = BeginHttpReply(io, session_id);
 					struct mg_rpc_req r = {
-					  .head = &s_rpc_head,
+					  .head = nullptr,
 					  .rpc = nullptr,
 					  .pfn = mg_pfn_iobuf,
-					  .pfn_data = &io,
-					  .req_data = nullptr,
+					  .pfn_data = io,
+					  .req_data = &req,
 					  .frame = hm->body,
 					};
-					mg_rpc_process(&r);
-					if (io.buf != NULL)
+					Dispatch(&r);
+					if (req.accepted)
+					{
+						io->len = mark;
+						char* headers = s_arena.Format("mcp-session-id: %.*s\r\n", (int)session_id.len, session_id.buf);
+						mg_http_reply(conn, 202, headers, "");
+					}
+					else if (req.deferred)
 					{
-						std::string headers = "Content-Type: text/event-stream\r\nmcp-session-id: " + session_id + "\r\n";
-						mg_http_reply(conn, 200, headers.c_str(), (char*)io.buf);
+						// The connection stays parked (is_resp is still set) until
+						// the worker's reply is flushed by FlushReplies().
+						io->len = mark;
+					}
+					else if (io->len > body)
+					{
+						EndHttpReply(io, body);
+						conn->is_resp = 0;
+						self->m_stat_response_bytes += io->len - mark;
 					}
 					else
 					{
+						io->len = mark;
 						mg_http_reply(conn, 500, "", "Internal Server Error");
 					}
-					mg_iobuf_free(&io);
 				}
 			}
 		}
@@ -262,305 +568,2334 @@ void McpServer::cbEvHander(void* connection, int event_code, void* event_data)
 	}
 }
 
-void McpServer::cbTimerHandler(void* timer_data)
-{
-	McpServer* self = (McpServer*)timer_data;
-	self->ClearSession();
-}
-
-bool McpServer::IsEnableSessionId(std::string session_id)
+// A signature check bound to one key, set up once when the JWKS is loaded;
+// the claims are checked separately on the scanned token
+struct McpServer::McpKeySet {
+	struct Key {
+		std::string algorithm;
+		std::function<bool(std::string_view data, std::string_view signature)> verify;
+	};
+	// By "kid". Keys published without one, or sharing one during a
+	// rotation, are all kept and tried in turn.
+	std::multimap<std::string, Key, std::less<>> keys;
+};
+
+// Tolerated clock skew for "exp", "nbf" and "iat", in seconds
+static const int64_t JWT_LEEWAY = 30;
+
+// How long a JWKS fetch may take before the refresh gives up, in milliseconds
+static const uint64_t JWKS_FETCH_TIMEOUT = 10 * 1000;
+
+static bool IsHttpUrl(const std::string& source)
 {
-	return m_sessions.find(session_id) != m_sessions.end();
-}
-
-void McpServer::EraseSession(std::string session_id)
-{
-	auto it = m_sessions.find(session_id);
-	if (it != m_sessions.end())
-	{
-		m_sessions.erase(it);
-	}
+	return source.compare(0, 7, "http://") == 0 || source.compare(0, 8, "https://") == 0;
 }
 
-void McpServer::ClearSession()
+std::shared_ptr<const McpServer::McpKeySet> McpServer::ParseKeySet(const std::string& jwks) const
 {
-	auto it = m_sessions.begin();
-	while (it != m_sessions.end())
+	auto key_set = std::make_shared<McpKeySet>();
+	auto keys = jwt::parse_jwks(jwks);
+	for (const auto& key : keys)
 	{
-		if (it->second > 0)
+		try
 		{
-			it->second--;
-			it++;
+			if (key.has_use() && key.get_use() != "sig")
+			{
+				continue;
+			}
+			std::string kid = key.has_key_id() ? key.get_key_id() : "";
+			std::string type = key.get_key_type();
+			std::string alg = key.has_algorithm() ? key.get_algorithm() : "";
+			auto add = [&key_set, &kid](const char* name, auto algorithm) {
+				key_set->keys.emplace(kid, McpKeySet::Key{
+					name,
+					[algorithm](std::string_view data, std::string_view signature) {
+						// The jwt-cpp algorithms take std::string; reusing
+						// per-thread copies keeps the check free of
+						// allocations once they have grown
+						static thread_local std::string data_copy;
+						static thread_local std::string signature_copy;
+						data_copy.assign(data);
+						signature_copy.assign(signature);
+						std::error_code ec;
+						algorithm.verify(data_copy, signature_copy, ec);
+						return !ec;
+					}
+				});
+			};
+
+			if (type == "RSA")
+			{
+				std::string pem = jwt::helper::create_public_key_from_rsa_components(
+					key.get_jwk_claim("n").as_string(),
+					key.get_jwk_claim("e").as_string()
+				);
+				if (alg.empty() || alg == "RS256") add("RS256", jwt::algorithm::rs256(pem));
+				else if (alg == "RS384") add("RS384", jwt::algorithm::rs384(pem));
+				else if (alg == "RS512") add("RS512", jwt::algorithm::rs512(pem));
+				else if (alg == "PS256") add("PS256", jwt::algorithm::ps256(pem));
+				else if (alg == "PS384") add("PS384", jwt::algorithm::ps384(pem));
+				else if (alg == "PS512") add("PS512", jwt::algorithm::ps512(pem));
+			}
+			else if (type == "EC")
+			{
+				std::string curve = key.get_curve();
+				std::string pem = jwt::helper::create_public_key_from_ec_components(
+					curve,
+					key.get_jwk_claim("x").as_string(),
+					key.get_jwk_claim("y").as_string()
+				);
+				if (curve == "P-256" && (alg.empty() || alg == "ES256")) add("ES256", jwt::algorithm::es256(pem));
+				else if (curve == "P-384" && (alg.empty() || alg == "ES384")) add("ES384", jwt::algorithm::es384(pem));
+				else if (curve == "P-521" && (alg.empty() || alg == "ES512")) add("ES512", jwt::algorithm::es512(pem));
+			}
+			else if (type == "oct" && alg == "HS256")
+			{
+				// A shared secret is only used when the key names HS256, so
+				// it never verifies a token claiming another algorithm
+				std::string k = key.get_jwk_claim("k").as_string();
+				std::string secret(McpBase64::DecodedSizeLimit(k.size()), '\0');
+				size_t secret_len;
+				if (!McpBase64::Decode(k, secret.data(), &secret_len, McpBase64::BASE64URL) || secret_len == 0)
+				{
+					continue;
+				}
+				secret.resize(secret_len);
+				McpHmacSha256 hmac(secret);
+				key_set->keys.emplace(kid, McpKeySet::Key{
+					"HS256",
+					[hmac](std::string_view data, std::string_view signature) {
+						return hmac.Verify(data, signature);
+					}
+				});
+			}
 		}
-		else
+		catch (const std::exception&)
 		{
-			it = m_sessions.erase(it);
+			// A malformed key is skipped; the rest of the set stays usable
 		}
 	}
+	return key_set;
 }
 
-void McpServer::cbInitialize(void* rpc_req)
+std::shared_ptr<const McpServer::McpKeySet> McpServer::LoadKeySet() const
 {
-	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
-	McpServer* self = (McpServer*)r->rpc->fn_data;
-	mg_json_rpc2_ok(r,
-		"{"
-			"\"protocolVersion\": \"2025-06-18\","
-			"\"capabilities\": {"
-				"\"logging\": {},"
-				"\"tools\": {}"
-			"},"
-			"\"serverInfo\": {"
-				"\"name\": \"%s\","
-				"\"version\" : \"1.0.0.0\""
-			"}"
-		"}",
-		self->m_server_name.c_str()
-	);
+	struct mg_str jwks = mg_file_read(&mg_fs_posix, m_jwks_source.c_str());
+	if (jwks.buf == nullptr)
+	{
+		throw std::runtime_error("cannot read " + m_jwks_source);
+	}
+	std::string json(jwks.buf, jwks.len);
+	mg_free((void*)jwks.buf);
+	return ParseKeySet(json);
 }
 
-void McpServer::cbLoggingSetLevel(void* rpc_req)
+std::shared_ptr<const McpServer::McpKeySet> McpServer::GetKeySet()
 {
-	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
-	mg_json_rpc2_ok(r, "{}");
+	std::lock_guard<std::mutex> lock(m_key_set_mutex);
+	return m_key_set;
 }
 
-void McpServer::cbToolsList(void* rpc_req)
+// Runs on the first event loop. The document is fetched without blocking
+// the loop and parsed on a worker; the new set replaces the old one only
+// if it parsed.
+McpDetachedTask McpServer::RefreshKeySet()
 {
-	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
-	McpServer* self = (McpServer*)r->rpc->fn_data;
-
-	std::string tools_json = "";
-	for (auto it = self->m_tools.begin(); it != self->m_tools.end(); it++)
+	std::string jwks;
+	if (IsHttpUrl(m_jwks_source))
 	{
-		McpTool& tool = it->second;
-
-		if (!tools_json.empty()) {
-			tools_json += ",";
+		// Keys fetched from an unverified server could sign any token
+		if (mg_url_is_ssl(m_jwks_source.c_str()) && m_jwks_ca.empty())
+		{
+			MG_ERROR(("JWKS fetch from %s failed: no CA file", m_jwks_source.c_str()));
+			m_jwks_refreshing = false;
+			co_return;
 		}
-		tools_json += "{"
-			"\"name\": \"" + tool.name + "\","
-			"\"description\": \"" + tool.description + "\"";
-
-		if (tool.input_schema.size() > 0)
+		McpHttpResponse response = co_await Fetch(m_jwks_source.c_str(), "GET", "", "", m_jwks_ca, JWKS_FETCH_TIMEOUT);
+		if (response.status != 200)
 		{
-			tools_json += ",\"inputSchema\": {"
-				"\"type\": \"object\","
-				"\"properties\": {";
-
-			std::string required_properties = "";
-
-			int i = 0;
-			for (auto it = tool.input_schema.begin(); it != tool.input_schema.end(); it++)
-			{
-				if (i > 0)
-				{
-					tools_json += ",";
-				}
-				const auto& prop = it->second;
-				tools_json += "\"" + prop.property_name + "\": {"
-					"\"type\": \"" + GetPropertyType(prop.property_type) + 
-					"\",\"description\": \"" + prop.description + "\"}";
-
-				if (prop.required) 
-				{
-					if (!required_properties.empty())
-					{
-						required_properties += ",";
-					}
-					required_properties += "\"" + prop.property_name + "\"";
-				}
-				i++;
-			}
-
-			tools_json += "}";
-
-			if (!required_properties.empty()) {
-				tools_json += ", \"required\": [" + required_properties + "]";
-			}
-
-			tools_json += "}";
+			MG_ERROR(("JWKS fetch from %s failed: %d", m_jwks_source.c_str(), response.status));
+			m_jwks_refreshing = false;
+			co_return;
 		}
+		jwks = std::move(response.body);
+	}
 
-		if (tool.output_schema.size() > 0)
+	std::function<std::shared_ptr<const McpKeySet>()> parse = [this, jwks = std::move(jwks)]() {
+		return jwks.empty() ? LoadKeySet() : ParseKeySet(jwks);
+	};
+	auto result = co_await RunOnWorker(std::move(parse));
+	if (result.first)
+	{
 		{
-			tools_json += ",\"outputSchema\": {"
-				"\"type\": \"object\","
-				"\"properties\": {"
-					"\"content\": {"
-						"\"type\": \"array\","
-						"\"items\": {"
-							"\"type\": \"object\","
-							"\"properties\": {";
-
-			std::string required_properties = "";
-
-			int i = 0;
-			for (auto it = tool.output_schema.begin(); it != tool.output_schema.end(); it++)
-			{
-				if (i > 0)
-				{
-					tools_json += ",";
-				}
-				const auto& prop = it->second;
-				tools_json += "\"" + prop.property_name + "\": {"
-					"\"type\": \"" + GetPropertyType(prop.property_type) +
-					"\",\"description\": \"" + prop.description + "\"}";
-
-				if (prop.required)
-				{
-					if (!required_properties.empty())
-					{
-						required_properties += ",";
-					}
-					required_properties += "\"" + prop.property_name + "\"";
-				}
-				i++;
-			}
-
-			tools_json += "}";
-
-			if (!required_properties.empty())
-			{
-				tools_json += ", \"required\": [" + required_properties + "]";
-			}
-
-			tools_json += "}}},\"required\": [\"content\"]}";
+			std::lock_guard<std::mutex> lock(m_key_set_mutex);
+			m_key_set = std::move(*result.first);
 		}
-
-		tools_json += "}";
+		// Tokens signed by a key that was dropped must not stay accepted
+		m_token_cache.Clear();
 	}
-
-	mg_json_rpc2_ok(
-		r,
-		"{\"tools\": [%s]}",
-		tools_json.c_str()
-	);
+	else
+	{
+		MG_ERROR(("JWKS from %s not loaded", m_jwks_source.c_str()));
+	}
+	m_jwks_refreshing = false;
 }
 
-std::string McpServer::GetPropertyType(PropertyType type)
+void McpServer::cbJwksTimer(void* timer_data)
 {
-	switch (type) {
-	case PROPERTY_NUMBER:
-		return "number";
-	case PROPERTY_STRING:
-		return "string";
-	default:
-		return "unknown";
+	McpServer* self = (McpServer*)timer_data;
+	if (!self->m_jwks_refreshing.exchange(true))
+	{
+		self->RefreshKeySet();
 	}
 }
 
-std::string McpServer::GetPropertyValue(const McpTool& tool, McpPropertyValue value, bool escape)
+bool McpServer::VerifyToken(std::string_view token)
 {
-	auto it = tool.output_schema.find(value.property_name);
-	if (it == tool.output_schema.end())
+	int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()
+	).count();
+	if (m_token_cache.Find(token, now))
 	{
-		return "";
+		return true;
 	}
 
-	switch (it->second.property_type) {
-	case PROPERTY_NUMBER:
-		return value.value;
-	case PROPERTY_STRING:
-		if (escape)
+	uint64_t generation = m_token_cache.Generation();
+	McpJwt jwt;
+	if (!jwt.Parse(token) || !jwt.HasAudience(m_url))
+	{
+		return false;
+	}
+	if (!m_jwks_source.empty())
+	{
+		if (jwt.HasExpiresAt() && now > jwt.ExpiresAt() + JWT_LEEWAY)
 		{
-			return "\\\"" + value.value + "\\\"";
+			return false;
 		}
-		else
+		if ((jwt.HasNotBefore() && now < jwt.NotBefore() - JWT_LEEWAY) || (jwt.HasIssuedAt() && now < jwt.IssuedAt() - JWT_LEEWAY))
 		{
-			return "\"" + value.value + "\"";
+			return false;
+		}
+		if (!m_jwks_issuer.empty() && (!jwt.HasIssuer() || jwt.Issuer() != m_jwks_issuer))
+		{
+			return false;
 		}
-	default:
-		return "";
-	}
-}
-
-void McpServer::cbToolsCall(void* rpc_req)
-{
-	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
-	McpServer* self = (McpServer*)r->rpc->fn_data;
 
-	char* name = mg_json_get_str(
-		r->frame, 
-		"$.params.name"
-	);
+		// Never waits for a refresh: until the first load a token fails
+		std::shared_ptr<const McpKeySet> key_set = GetKeySet();
+		if (!key_set)
+		{
+			return false;
+		}
+		auto keys = key_set->keys.equal_range(jwt.KeyId());
+		bool verified = false;
+		for (auto it = keys.first; it != keys.second && !verified; it++)
+		{
+			verified = it->second.algorithm == jwt.Algorithm() && it->second.verify(jwt.SigningInput(), jwt.Signature());
+		}
+		if (!verified)
+		{
+			return false;
+		}
+	}
 
-	auto it = self->m_tools.find(name);
-	if (it == self->m_tools.end())
+	// Tokens without "exp", or accepted only through the leeway, are
+	// verified every time
+	if (jwt.HasExpiresAt() && jwt.ExpiresAt() > now)
 	{
-		mg_json_rpc2_err(r, -32602, "Unknown tool: invalid_tool_name");
-		return;
+		m_token_cache.Insert(token, jwt.ExpiresAt(), jwt.Scope(), generation);
 	}
+	return true;
+}
 
-	std::map<std::string, std::string> arguments;
-
-	McpTool& tool = it->second;
-	for (auto it2 = tool.input_schema.begin(); it2 != tool.input_schema.end(); it2++)
+bool McpServer::CheckAuthorization(void* connection, std::string_view auth_token)
+{
+	if (!m_authorization)
 	{
-		const auto& prop = it2->second;
-		std::string property_name = "$.params.arguments." + prop.property_name;
-		char* value = mg_json_get_str(
-			r->frame,
-			property_name.c_str()
-		);
-		arguments[prop.property_name] = value ? value : "";
+		return true;
 	}
 
-	std::vector<McpContent> contents = tool.callback(arguments);
-	std::string content_json = "";
-	std::string structured_content_json = "";
+	bool authorization_chk = false;
 
-	if (tool.output_schema.size() == 0)
+	if (auth_token.size() > 7)
 	{
-		for (size_t i = 0; i < contents.size(); i++)
+		if (mg_strcasecmp(mg_str_n(auth_token.data(), 7), mg_str("Bearer ")) == 0)
 		{
-			if (i > 0) {
-				content_json += ",";
-			}
-			content_json += "{"
-				"\"type\": \"" + GetPropertyType(contents[i].property_type) + "\","
-				"\"text\": \"" + contents[i].value + "\""
-				"}";
+			authorization_chk = VerifyToken(auth_token.substr(7));
 		}
+	}
 
-		mg_json_rpc2_ok(
-			r,
-			"{\"content\": [%s]}",
-			content_json.c_str()
+	if (!authorization_chk)
+	{
+		std::string authenticate_header = "WWW-Authenticate: Bearer resource_metadata=\"";
+		authenticate_header += m_host;
+		authenticate_header += "/.well-known/oauth-protected-resource";
+		authenticate_header += m_entry_point;
+		authenticate_header += "\"\r\n";
+		mg_http_reply(
+			(mg_connection*)connection,
+			401,
+			authenticate_header.c_str(),
+			""
+		);
+	}
+	return authorization_chk;
+}
+
+void McpServer::cbTimerHandler(void* timer_data)
+{
+	McpServer* self = (McpServer*)timer_data;
+	self->ClearSession();
+}
+
+bool McpServer::IsEnableSessionId(std::string_view session_id)
+{
+	std::lock_guard<std::mutex> lock(m_session_mutex);
+	return m_sessions.find(session_id) != m_sessions.end();
+}
+
+void McpServer::TouchSession(std::string_view session_id)
+{
+	std::lock_guard<std::mutex> lock(m_session_mutex);
+	auto it = m_sessions.find(session_id);
+	if (it != m_sessions.end())
+	{
+		it->second.ttl = 1;
+	}
+	else
+	{
+		m_sessions.emplace(session_id, McpSession{ 1, nullptr });
+	}
+}
+
+void McpServer::EraseSession(std::string_view session_id)
+{
+	std::shared_ptr<McpEventStream> events;
+	{
+		std::lock_guard<std::mutex> lock(m_session_mutex);
+		auto it = m_sessions.find(session_id);
+		if (it != m_sessions.end())
+		{
+			events = std::move(it->second.events);
+			m_sessions.erase(it);
+		}
+	}
+	if (events)
+	{
+		CloseEventStream(events);
+	}
+}
+
+void McpServer::ClearSession()
+{
+	std::vector<std::shared_ptr<McpEventStream>> closed;
+	{
+		std::lock_guard<std::mutex> lock(m_session_mutex);
+		auto it = m_sessions.begin();
+		while (it != m_sessions.end())
+		{
+			// An open GET stream keeps its session alive
+			bool streaming = false;
+			if (it->second.events)
+			{
+				std::lock_guard<std::mutex> stream_lock(it->second.events->mutex);
+				streaming = it->second.events->connection_id != 0;
+			}
+
+			if (streaming)
+			{
+				it->second.ttl = 1;
+				it++;
+			}
+			else if (it->second.ttl > 0)
+			{
+				it->second.ttl--;
+				it++;
+			}
+			else
+			{
+				if (it->second.events)
+				{
+					closed.push_back(std::move(it->second.events));
+				}
+				it = m_sessions.erase(it);
+			}
+		}
+	}
+	for (auto& events : closed)
+	{
+		CloseEventStream(events);
+	}
+}
+
+std::shared_ptr<McpServer::McpEventStream> McpServer::GetEventStream(std::string_view session_id)
+{
+	std::lock_guard<std::mutex> lock(m_session_mutex);
+	auto it = m_sessions.find(session_id);
+	if (it == m_sessions.end())
+	{
+		return nullptr;
+	}
+	if (!it->second.events)
+	{
+		it->second.events = std::make_shared<McpEventStream>();
+	}
+	return it->second.events;
+}
+
+// Copies len bytes into the ring at offset, wrapping around its end
+static void RingWrite(std::vector<char>& ring, size_t offset, const char* buf, size_t len)
+{
+	size_t n = std::min(len, ring.size() - offset);
+	memcpy(&ring[offset], buf, n);
+	memcpy(&ring[0], buf + n, len - n);
+}
+
+bool McpServer::AppendEvent(const std::shared_ptr<McpEventStream>& events, const char* frame, size_t len)
+{
+	McpEventStream& stream = *events;
+	McpLoop* loop = nullptr;
+	unsigned long connection_id = 0;
+	{
+		std::lock_guard<std::mutex> lock(stream.mutex);
+		char id_line[32] = "id: ";
+		std::to_chars_result result = std::to_chars(id_line + 4, id_line + sizeof(id_line) - 1, stream.next_id);
+		*result.ptr++ = '\n';
+		size_t id_len = (size_t)(result.ptr - id_line);
+
+		size_t capacity = stream.ring.empty() ? m_session_event_buffer : stream.ring.size();
+		if (stream.closed || id_len + len > capacity)
+		{
+			return false;
+		}
+		if (stream.ring.empty())
+		{
+			stream.ring.resize(capacity);
+		}
+
+		// Drop the oldest events until the new one fits
+		while (capacity - stream.used < id_len + len)
+		{
+			const McpEventStream::McpEvent& oldest = stream.events.front();
+			stream.head = (stream.head + oldest.len) % capacity;
+			stream.used -= oldest.len;
+			stream.events.pop_front();
+		}
+		if (stream.used == 0)
+		{
+			stream.head = 0;
+		}
+
+		size_t offset = (stream.head + stream.used) % capacity;
+		RingWrite(stream.ring, offset, id_line, id_len);
+		RingWrite(stream.ring, (offset + id_len) % capacity, frame, len);
+		stream.events.push_back({ stream.next_id++, offset, id_len + len });
+		stream.used += id_len + len;
+
+		if (stream.connection_id != 0 && !stream.queued)
+		{
+			stream.queued = true;
+			loop = stream.loop;
+			connection_id = stream.connection_id;
+		}
+	}
+	if (loop != nullptr)
+	{
+		PostStreamFlush(loop, events, connection_id);
+	}
+	return true;
+}
+
+void McpServer::CloseEventStream(const std::shared_ptr<McpEventStream>& events)
+{
+	McpEventStream& stream = *events;
+	McpLoop* loop;
+	unsigned long connection_id;
+	{
+		std::lock_guard<std::mutex> lock(stream.mutex);
+		stream.closed = true;
+		loop = stream.loop;
+		connection_id = stream.connection_id;
+	}
+	if (connection_id != 0)
+	{
+		PostStreamFlush(loop, events, connection_id);
+	}
+}
+
+// Writes the events after the stream's cursor; the caller holds the lock
+void McpServer::WriteEvents(void* connection, McpEventStream& stream)
+{
+	mg_connection* conn = (mg_connection*)connection;
+	if (stream.events.empty())
+	{
+		return;
+	}
+	// Ids in the ring are consecutive, so the cursor maps to an index
+	uint64_t first = stream.events.front().id;
+	size_t capacity = stream.ring.size();
+	for (size_t i = stream.sent_id >= first ? (size_t)(stream.sent_id - first + 1) : 0; i < stream.events.size(); i++)
+	{
+		const McpEventStream::McpEvent& event = stream.events[i];
+		size_t n = std::min(event.len, capacity - event.offset);
+		mg_send(conn, &stream.ring[event.offset], n);
+		if (n < event.len)
+		{
+			mg_send(conn, &stream.ring[0], event.len - n);
+		}
+	}
+	stream.sent_id = stream.events.back().id;
+}
+
+void McpServer::OpenEventStream(void* connection, std::string_view session_id, std::string_view last_event_id)
+{
+	mg_connection* conn = (mg_connection*)connection;
+	McpLoop* loop = (McpLoop*)conn->mgr->userdata;
+	std::shared_ptr<McpEventStream> stream = GetEventStream(session_id);
+	if (!stream)
+	{
+		mg_http_reply(conn, 400, "", "");
+		return;
+	}
+
+	// No Content-Length: the body lasts as long as the connection
+	mg_printf(conn,
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/event-stream\r\n"
+		"Cache-Control: no-cache\r\n"
+		"mcp-session-id: %.*s\r\n"
+		"\r\n",
+		(int)session_id.size(), session_id.data()
+	);
+
+	McpLoop* previous_loop;
+	unsigned long previous_id;
+	{
+		std::lock_guard<std::mutex> lock(stream->mutex);
+		previous_loop = stream->loop;
+		previous_id = stream->connection_id;
+		stream->loop = loop;
+		stream->connection_id = conn->id;
+		stream->queued = false;
+
+		// A fresh stream starts after the newest event; a resumed one after
+		// the last event the client saw, as far as the ring still reaches
+		stream->sent_id = stream->next_id - 1;
+		uint64_t last_id;
+		if (!last_event_id.empty()
+			&& std::from_chars(last_event_id.data(), last_event_id.data() + last_event_id.size(), last_id).ec == std::errc()
+			&& last_id < stream->sent_id)
+		{
+			stream->sent_id = last_id;
+		}
+		WriteEvents(conn, *stream);
+	}
+	loop->attached[conn->id] = stream;
+
+	// One GET stream per session; the one it replaces is closed
+	if (previous_id != 0)
+	{
+		PostStreamFlush(previous_loop, stream, previous_id);
+	}
+}
+
+void McpServer::SetSessionEventBuffer(size_t bytes)
+{
+	m_session_event_buffer = bytes;
+}
+
+bool McpServer::SendNotification(const char* session_id, const char* method, const char* params)
+{
+	std::shared_ptr<McpEventStream> stream = GetEventStream(session_id);
+	if (!stream)
+	{
+		return false;
+	}
+
+	struct mg_iobuf io = { nullptr, 0, 0, 256, false };
+	mg_xprintf(mg_pfn_iobuf, &io, "event: message\ndata: {\"jsonrpc\":\"2.0\",\"method\":%m", mg_print_esc, 0, method);
+	if (params != nullptr && params[0] != '\0')
+	{
+		size_t start = io.len;
+		mg_xprintf(mg_pfn_iobuf, &io, ",\"params\":%s", params);
+		// Line breaks in the caller's JSON can only be whitespace, and a
+		// data: line must not contain any
+		for (size_t i = start; i < io.len; i++)
+		{
+			if (io.buf[i] == '\n' || io.buf[i] == '\r')
+			{
+				io.buf[i] = ' ';
+			}
+		}
+	}
+	mg_xprintf(mg_pfn_iobuf, &io, "}\n\n");
+	bool result = AppendEvent(stream, (const char*)io.buf, io.len);
+	mg_iobuf_free(&io);
+	return result;
+}
+
+// FNV-1a with a seed, used to build collision-free name tables
+static uint32_t HashMethod(const char* buf, size_t len, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ seed;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char)buf[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void McpServer::McpNameIndex::Build()
+{
+	// Search for a seed that gives every name its own slot so that a lookup
+	// is one hash and one compare; grow the table if no seed is found
+	size_t size = 1;
+	while (size < names.size() * 2)
+	{
+		size <<= 1;
+	}
+	for (;; size <<= 1)
+	{
+		for (seed = 0; seed < 1024; seed++)
+		{
+			slots.assign(size, -1);
+			bool collision = false;
+			for (size_t i = 0; i < names.size() && !collision; i++)
+			{
+				int& slot = slots[HashMethod(names[i].data(), names[i].size(), seed) & (size - 1)];
+				collision = slot >= 0;
+				slot = (int)i;
+			}
+			if (!collision)
+			{
+				return;
+			}
+		}
+	}
+}
+
+int McpServer::McpNameIndex::Find(std::string_view name) const
+{
+	if (slots.empty())
+	{
+		return -1;
+	}
+	int slot = slots[HashMethod(name.data(), name.size(), seed) & (slots.size() - 1)];
+	if (slot < 0 || names[slot] != name)
+	{
+		return -1;
+	}
+	return slot;
+}
+
+void McpServer::AddMethod(const char* method, void (*handler)(void* rpc_req), bool notification)
+{
+	m_method_index.names.push_back(method);
+	m_methods.push_back({ handler, notification });
+}
+
+const McpServer::McpMethod* McpServer::FindMethod(std::string_view method) const
+{
+	int index = m_method_index.Find(method);
+	return index >= 0 ? &m_methods[index] : nullptr;
+}
+
+void McpServer::Dispatch(void* rpc_req)
+{
+	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
+	McpRequest* req = (McpRequest*)r->req_data;
+	struct mg_str method = req->method;
+	const McpMethod* entry = req->server->FindMethod(std::string_view(method.buf, method.len));
+	if (entry != nullptr)
+	{
+		entry->handler(r);
+		req->accepted = entry->notification;
+	}
+	else if (method.len > 14 && memcmp(method.buf, "notifications/", 14) == 0)
+	{
+		// Unknown notifications are accepted and ignored
+		req->accepted = true;
+	}
+	else
+	{
+		mg_json_rpc2_err(r, -32601, "\"%.*s not found\"", (int)method.len, method.buf);
+	}
+}
+
+void McpServer::cbInitialize(void* rpc_req)
+{
+	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
+	McpServer* self = ((McpRequest*)r->req_data)->server;
+
+	std::shared_ptr<const McpResultCache> cache = self->GetResultCache();
+	const std::string& result = cache->initialize_result;
+	mg_json_rpc2_ok(r, "%.*s", (int)result.size(), result.data());
+}
+
+void McpServer::cbLoggingSetLevel(void* rpc_req)
+{
+	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
+	mg_json_rpc2_ok(r, "{}");
+}
+
+void McpServer::cbNotificationsInitialized(void* /* rpc_req */)
+{
+}
+
+void McpServer::cbNotificationsCancelled(void* rpc_req)
+{
+	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
+	McpRequest* req = (McpRequest*)r->req_data;
+	if (req == nullptr)
+	{
+		return;
+	}
+	McpServer* self = req->server;
+
+	int id_len, id_off = mg_json_get(req->params, "$.requestId", &id_len);
+	if (id_off <= 0)
+	{
+		return;
+	}
+	std::string key = CancellationKey(
+		std::string_view(req->session_id.buf, req->session_id.len),
+		std::string_view(&req->params.buf[id_off], (size_t)id_len)
+	);
+
+	std::shared_ptr<McpCancellation> cancellation;
+	{
+		std::lock_guard<std::mutex> lock(self->m_cancel_mutex);
+		auto it = self->m_cancellations.find(key);
+		if (it == self->m_cancellations.end())
+		{
+			return;
+		}
+		cancellation = std::move(it->second);
+		self->m_cancellations.erase(it);
+	}
+
+	// Too late if the reply is already on its way
+	if (cancellation->replied.exchange(true))
+	{
+		return;
+	}
+	cancellation->source.request_stop();
+
+	// No response is sent for a cancelled request: the HTTP reply is an
+	// empty event stream
+	struct mg_iobuf io = AcquireReplyBuffer();
+	EndHttpReply(&io, BeginHttpReply(&io, req->session_id));
+	PostReply(cancellation->loop, { cancellation->connection_id, io.buf, io.size, io.len });
+}
+
+std::string McpServer::CancellationKey(std::string_view session_id, std::string_view id)
+{
+	std::string key;
+	key.reserve(session_id.size() + 1 + id.size());
+	key.append(session_id);
+	key += '\n';
+	key.append(id);
+	return key;
+}
+
+void McpServer::EndCancellation(const std::shared_ptr<McpCancellation>& cancellation)
+{
+	std::lock_guard<std::mutex> lock(m_cancel_mutex);
+	auto it = m_cancellations.find(cancellation->key);
+	if (it != m_cancellations.end() && it->second == cancellation)
+	{
+		m_cancellations.erase(it);
+	}
+}
+
+std::stop_token McpServer::McpArguments::StopToken() const
+{
+	return m_cancellation ? m_cancellation->source.get_token() : std::stop_token();
+}
+
+void McpServer::McpArguments::OnCancel(std::function<void()> hook) const
+{
+	if (!m_cancellation)
+	{
+		return;
+	}
+	auto callback = std::make_unique<std::stop_callback<std::function<void()>>>(m_cancellation->source.get_token(), std::move(hook));
+	std::lock_guard<std::mutex> lock(m_cancellation->hook_mutex);
+	m_cancellation->hooks.push_back(std::move(callback));
+}
+
+void McpServer::AppendToolJson(std::string& tools_json, const McpTool& tool)
+{
+	tools_json += "{"
+		"\"name\": \"" + tool.name + "\","
+		"\"description\": \"" + tool.description + "\"";
+
+	if (tool.input_schema.size() > 0)
+	{
+		tools_json += ",\"inputSchema\": {"
+			"\"type\": \"object\","
+			"\"properties\": {";
+
+		std::string required_properties = "";
+
+		int i = 0;
+		for (auto it = tool.input_schema.begin(); it != tool.input_schema.end(); it++)
+		{
+			if (i > 0)
+			{
+				tools_json += ",";
+			}
+			const auto& prop = it->second;
+			tools_json += "\"" + prop.property_name + "\": {"
+				"\"type\": \"" + GetPropertyType(prop.property_type) + 
+				"\",\"description\": \"" + prop.description + "\"}";
+
+			if (prop.required) 
+			{
+				if (!required_properties.empty())
+				{
+					required_properties += ",";
+				}
+				required_properties += "\"" + prop.property_name + "\"";
+			}
+			i++;
+		}
+
+		tools_json += "}";
+
+		if (!required_properties.empty()) {
+			tools_json += ", \"required\": [" + required_properties + "]";
+		}
+
+		tools_json += "}";
+	}
+
+	if (tool.output_schema.size() > 0)
+	{
+		tools_json += ",\"outputSchema\": {"
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"content\": {"
+					"\"type\": \"array\","
+					"\"items\": {"
+						"\"type\": \"object\","
+						"\"properties\": {";
+
+		std::string required_properties = "";
+
+		int i = 0;
+		for (auto it = tool.output_schema.begin(); it != tool.output_schema.end(); it++)
+		{
+			if (i > 0)
+			{
+				tools_json += ",";
+			}
+			const auto& prop = it->second;
+			tools_json += "\"" + prop.property_name + "\": {"
+				"\"type\": \"" + GetPropertyType(prop.property_type) +
+				"\",\"description\": \"" + prop.description + "\"}";
+
+			if (prop.required)
+			{
+				if (!required_properties.empty())
+				{
+					required_properties += ",";
+				}
+				required_properties += "\"" + prop.property_name + "\"";
+			}
+			i++;
+		}
+
+		tools_json += "}";
+
+		if (!required_properties.empty())
+		{
+			tools_json += ", \"required\": [" + required_properties + "]";
+		}
+
+		tools_json += "}}},\"required\": [\"content\"]}";
+	}
+
+	tools_json += "}";
+}
+
+void McpServer::BuildResultCache()
+{
+	auto cache = std::make_shared<McpResultCache>();
+
+	cache->initialize_result = "{"
+		"\"protocolVersion\": \"2025-06-18\","
+		"\"capabilities\": {"
+			"\"logging\": {},"
+			"\"tools\": {}"
+		"},"
+		"\"serverInfo\": {"
+			"\"name\": \"" + m_server_name + "\","
+			"\"version\" : \"1.0.0.0\""
+		"}"
+	"}";
+
+	// tools/list pages; the cursor is the index of the next page
+	size_t page_size = m_tools_page_size > 0 ? m_tools_page_size : m_tools.size();
+	auto it = m_tools.begin();
+	do
+	{
+		std::string tools_json = "";
+		for (size_t i = 0; i < page_size && it != m_tools.end(); i++, it++)
+		{
+			if (!tools_json.empty()) {
+				tools_json += ",";
+			}
+			AppendToolJson(tools_json, it->second);
+		}
+
+		std::string page = "{\"tools\": [" + tools_json + "]";
+		if (it != m_tools.end())
+		{
+			page += ",\"nextCursor\": \"" + std::to_string(cache->tools_pages.size() + 1) + "\"";
+		}
+		page += "}";
+		cache->tools_pages.push_back(std::move(page));
+	} while (it != m_tools.end());
+
+	std::lock_guard<std::mutex> lock(m_result_cache_mutex);
+	m_result_cache = cache;
+}
+
+std::shared_ptr<const McpServer::McpResultCache> McpServer::GetResultCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_result_cache_mutex);
+		if (m_result_cache)
+		{
+			return m_result_cache;
+		}
+	}
+	BuildResultCache();
+	std::lock_guard<std::mutex> lock(m_result_cache_mutex);
+	return m_result_cache;
+}
+
+void McpServer::cbToolsList(void* rpc_req)
+{
+	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
+	McpRequest* req = (McpRequest*)r->req_data;
+	McpServer* self = req->server;
+
+	std::shared_ptr<const McpResultCache> cache = self->GetResultCache();
+
+	size_t page = 0;
+	char* cursor = ArenaJsonStr(req->params, "$.cursor");
+	if (cursor != nullptr)
+	{
+		char* end = nullptr;
+		unsigned long value = strtoul(cursor, &end, 10);
+		if (*cursor == '\0' || *end != '\0' || value == 0 || value >= cache->tools_pages.size())
+		{
+			mg_json_rpc2_err(r, -32602, "\"Invalid cursor\"");
+			return;
+		}
+		page = (size_t)value;
+	}
+
+	const std::string& result = cache->tools_pages[page];
+	mg_json_rpc2_ok(r, "%.*s", (int)result.size(), result.data());
+}
+
+std::string McpServer::GetPropertyType(PropertyType type)
+{
+	switch (type) {
+	case PROPERTY_NUMBER:
+		return "number";
+	case PROPERTY_STRING:
+		return "string";
+	case PROPERTY_OBJECT:
+		return "object";
+	case PROPERTY_INTEGER:
+		return "integer";
+	case PROPERTY_BOOLEAN:
+		return "boolean";
+	case PROPERTY_ARRAY:
+		return "array";
+	default:
+		return "unknown";
+	}
+}
+
+void McpServer::WritePropertyValue(McpJsonWriter& writer, PropertyType type, const McpPropertyValue& value)
+{
+	// Typed results are formatted here rather than passed in as text
+	switch (value.typed_value.GetType()) {
+	case McpValue::VALUE_BOOL:
+		writer.Bool(value.typed_value.AsBool());
+		return;
+	case McpValue::VALUE_INTEGER:
+		writer.Integer(value.typed_value.AsInteger());
+		return;
+	case McpValue::VALUE_NUMBER:
+		writer.Number(value.typed_value.AsNumber());
+		return;
+	case McpValue::VALUE_NULL:
+		writer.Raw("null", 4);
+		return;
+	default:
+		break;
+	}
+
+	switch (type) {
+	case PROPERTY_STRING:
+		writer.String(value.value);
+		break;
+	default:
+		// Numbers, booleans, objects and arrays given as JSON text
+		writer.Raw(value.value);
+		break;
+	}
+}
+
+// Copies a JSON string token unescaped into the argument storage. The
+// storage is reserved for the whole arguments object up front, so views
+// handed out earlier stay valid.
+static bool StoreString(std::vector<char>& storage, struct mg_str token, std::string_view* out)
+{
+	if (token.len < 2 || token.buf[0] != '"')
+	{
+		return false;
+	}
+	size_t start = storage.size();
+	if (start + token.len > storage.capacity())
+	{
+		return false;
+	}
+	storage.resize(start + token.len);
+	if (!mg_json_unescape(mg_str_n(token.buf + 1, token.len - 2), &storage[start], token.len))
+	{
+		storage.resize(start);
+		return false;
+	}
+	size_t len = strlen(&storage[start]);
+	storage.resize(start + len + 1);
+	*out = std::string_view(&storage[start], len);
+	return true;
+}
+
+int64_t McpServer::McpValue::AsInteger(int64_t def) const
+{
+	switch (m_type) {
+	case VALUE_INTEGER:
+		return m_integer;
+	case VALUE_NUMBER:
+		return (int64_t)m_number;
+	default:
+		return def;
+	}
+}
+
+double McpServer::McpValue::AsNumber(double def) const
+{
+	switch (m_type) {
+	case VALUE_INTEGER:
+		return (double)m_integer;
+	case VALUE_NUMBER:
+		return m_number;
+	default:
+		return def;
+	}
+}
+
+const McpServer::McpValue* McpServer::McpValue::Find(std::string_view key) const
+{
+	if (m_type != VALUE_OBJECT)
+	{
+		return nullptr;
+	}
+	for (size_t i = 0; i < m_size; i++)
+	{
+		if (m_children[i].m_key == key)
+		{
+			return &m_children[i];
+		}
+	}
+	return nullptr;
+}
+
+const McpServer::McpValue& McpServer::McpArguments::operator[](std::string_view name) const
+{
+	static const McpValue none;
+	int index = IndexOf(name);
+	return index >= 0 ? m_values[index] : none;
+}
+
+bool McpServer::DecodeValue(McpArguments& arguments, size_t index, const char* json, size_t len)
+{
+	struct mg_str token = mg_str_n(json, len);
+	if (len == 0)
+	{
+		return false;
+	}
+
+	switch (json[0]) {
+	case '"':
+	{
+		std::string_view str;
+		if (!StoreString(arguments.m_storage, token, &str))
+		{
+			return false;
+		}
+		arguments.m_values[index].m_type = McpValue::VALUE_STRING;
+		arguments.m_values[index].m_string = str;
+		return true;
+	}
+	case '{':
+	case '[':
+	{
+		// Children are laid out next to each other first, holding their raw
+		// token until they are decoded in turn
+		bool object = json[0] == '{';
+		size_t first = arguments.m_values.size();
+		struct mg_str key, val;
+		size_t ofs = 0;
+		while ((ofs = mg_json_next(token, ofs, &key, &val)) > 0)
+		{
+			McpValue child;
+			if (object && !StoreString(arguments.m_storage, key, &child.m_key))
+			{
+				return false;
+			}
+			child.m_string = std::string_view(val.buf, val.len);
+			arguments.m_values.push_back(child);
+		}
+		size_t count = arguments.m_values.size() - first;
+		arguments.m_values[index].m_type = object ? McpValue::VALUE_OBJECT : McpValue::VALUE_ARRAY;
+		arguments.m_values[index].m_string = std::string_view(json, len);
+		arguments.m_values[index].m_first = first;
+		arguments.m_values[index].m_size = count;
+		for (size_t i = first; i < first + count; i++)
+		{
+			std::string_view raw = arguments.m_values[i].m_string;
+			arguments.m_values[i].m_string = std::string_view();
+			if (!DecodeValue(arguments, i, raw.data(), raw.size()))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	default:
+		break;
+	}
+
+	McpValue& value = arguments.m_values[index];
+	value.m_string = std::string_view(json, len);
+	if (mg_strcmp(token, mg_str("true")) == 0 || mg_strcmp(token, mg_str("false")) == 0)
+	{
+		value.m_type = McpValue::VALUE_BOOL;
+		value.m_bool = json[0] == 't';
+		return true;
+	}
+	if (mg_strcmp(token, mg_str("null")) == 0)
+	{
+		value.m_type = McpValue::VALUE_NULL;
+		return true;
+	}
+
+	const char* end = json + len;
+	if (std::find_if(json, end, [](char c) { return c == '.' || c == 'e' || c == 'E'; }) == end)
+	{
+		auto result = std::from_chars(json, end, value.m_integer);
+		if (result.ec == std::errc() && result.ptr == end)
+		{
+			value.m_type = McpValue::VALUE_INTEGER;
+			return true;
+		}
+	}
+	auto result = std::from_chars(json, end, value.m_number);
+	if (result.ec == std::errc() && result.ptr == end)
+	{
+		value.m_type = McpValue::VALUE_NUMBER;
+		return true;
+	}
+	return false;
+}
+
+// Accepts the decoded value for a schema type. Numbers sent as strings are
+// converted, other mismatches are rejected.
+bool McpServer::CheckArgumentType(McpValue& value, PropertyType type)
+{
+	McpValue::Type t = value.GetType();
+	if ((type == PROPERTY_NUMBER || type == PROPERTY_INTEGER) && t == McpValue::VALUE_STRING)
+	{
+		const char* begin = value.m_string.data();
+		const char* end = begin + value.m_string.size();
+		int64_t integer;
+		double number;
+		auto result = std::from_chars(begin, end, integer);
+		if (result.ec == std::errc() && result.ptr == end)
+		{
+			value.m_type = t = McpValue::VALUE_INTEGER;
+			value.m_integer = integer;
+		}
+		else if ((result = std::from_chars(begin, end, number)).ec == std::errc() && result.ptr == end)
+		{
+			value.m_type = t = McpValue::VALUE_NUMBER;
+			value.m_number = number;
+		}
+	}
+
+	switch (type) {
+	case PROPERTY_NUMBER:
+		return t == McpValue::VALUE_INTEGER || t == McpValue::VALUE_NUMBER;
+	case PROPERTY_INTEGER:
+		return t == McpValue::VALUE_INTEGER;
+	case PROPERTY_STRING:
+		return t == McpValue::VALUE_STRING;
+	case PROPERTY_BOOLEAN:
+		return t == McpValue::VALUE_BOOL;
+	case PROPERTY_OBJECT:
+		return t == McpValue::VALUE_OBJECT;
+	case PROPERTY_ARRAY:
+		return t == McpValue::VALUE_ARRAY;
+	default:
+		return true;
+	}
+}
+
+bool McpServer::ExtractArguments(void* rpc_req, const McpTool& tool, const char* json, size_t len, McpArguments& arguments)
+{
+	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
+
+	size_t count = tool.arguments.names.size();
+	arguments.m_index = &tool.arguments;
+	arguments.m_count = count;
+	arguments.m_values.assign(count, McpValue());
+	// The raw JSON is copied first so that values can keep views of their
+	// text; unescaped strings follow it and never need more than its size
+	arguments.m_storage.reserve(2 * len + 1);
+	arguments.m_storage.assign(json, json + len);
+	json = arguments.m_storage.data();
+
+	// One walk over the arguments object; keys outside the schema cost a
+	// hash and are skipped
+	struct mg_str object = mg_str_n(json, len), key, val;
+	size_t ofs = 0;
+	while (object.buf != nullptr && (ofs = mg_json_next(object, ofs, &key, &val)) > 0)
+	{
+		if (key.len < 2)
+		{
+			continue;
+		}
+		std::string_view name(key.buf + 1, key.len - 2);
+		if (name.find('\\') != std::string_view::npos)
+		{
+			char* unescaped = (char*)s_arena.Allocate(name.size() + 1, 1);
+			if (!mg_json_unescape(mg_str_n(name.data(), name.size()), unescaped, name.size() + 1))
+			{
+				continue;
+			}
+			name = unescaped;
+		}
+
+		int index = tool.arguments.Find(name);
+		if (index < 0)
+		{
+			continue;
+		}
+
+		arguments.m_values[index] = McpValue();
+		if (!DecodeValue(arguments, index, val.buf, val.len) || !CheckArgumentType(arguments.m_values[index], tool.types[index]))
+		{
+			mg_json_rpc2_err(r, -32602, "\"Invalid argument: %s\"", tool.arguments.names[index].c_str());
+			return false;
+		}
+	}
+
+	// Containers were decoded into a growing vector; point them at their
+	// children now that it no longer moves
+	for (auto& value : arguments.m_values)
+	{
+		if (value.m_type == McpValue::VALUE_OBJECT || value.m_type == McpValue::VALUE_ARRAY)
+		{
+			value.m_children = arguments.m_values.data() + value.m_first;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (tool.required[i] && arguments.m_values[i].IsNone())
+		{
+			mg_json_rpc2_err(r, -32602, "\"Missing required argument: %s\"", tool.arguments.names[i].c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+// Builds the complete HTTP response for a deferred call on the calling
+// thread and queues it for the connection's event loop
+void McpServer::PostToolReply(const McpPendingCall& call, const std::vector<McpContent>* contents, const char* error)
+{
+	McpServer* self = call.server;
+	if (call.cancellation->replied.exchange(true))
+	{
+		// Cancelled, the empty reply was already sent
+		return;
+	}
+	self->EndCancellation(call.cancellation);
+
+	McpArenaScope arena_scope;
+	McpBufferMeter meter(self->m_stat_allocations, self->m_stat_bytes_copied);
+	McpRequest wreq = {
+	  .server = self,
+	  .loop = call.loop,
+	  .connection_id = call.connection_id,
+	  .session_id = mg_str_n(call.session_id.data(), call.session_id.size()),
+	  .deferred = true,
+	  .accepted = false,
+	  .jsonrpc = mg_str_n(nullptr, 0),
+	  .id = mg_str_n(call.id.data(), call.id.size()),
+	  .method = mg_str_n(nullptr, 0),
+	  .params = mg_str_n(nullptr, 0),
+	};
+	struct mg_iobuf io = AcquireReplyBuffer();
+	size_t body = BeginHttpReply(&io, wreq.session_id);
+	struct mg_rpc_req wr = {
+	  .head = nullptr,
+	  .rpc = nullptr,
+	  .pfn = mg_pfn_iobuf,
+	  .pfn_data = &io,
+	  .req_data = &wreq,
+	  .frame = mg_str_n(nullptr, 0),
+	};
+	try
+	{
+		if (contents != nullptr)
+		{
+			WriteToolResult(&wr, *call.tool, *contents);
+		}
+	}
+	catch (...)
+	{
+		contents = nullptr;
+		error = "Internal error";
+	}
+	if (contents == nullptr)
+	{
+		io.len = body;
+		mg_json_rpc2_err(&wr, -32603, "%m", mg_print_esc, 0, error);
+	}
+	EndHttpReply(&io, body);
+	PostReply(call.loop, { call.connection_id, io.buf, io.size, io.len });
+}
+
+struct McpServer::McpCompletion::State {
+	McpPendingCall call;
+	std::atomic<bool> done;
+
+	State(McpPendingCall&& call)
+		: call(std::move(call))
+		, done(false)
+	{
+	}
+	~State()
+	{
+		if (!done)
+		{
+			PostToolReply(call, nullptr, "Tool did not complete");
+		}
+	}
+};
+
+void McpServer::McpCompletion::Complete(std::vector<McpContent> contents) const
+{
+	if (m_state && !m_state->done.exchange(true))
+	{
+		PostToolReply(m_state->call, &contents, nullptr);
+	}
+}
+
+void McpServer::McpCompletion::Fail(const char* message) const
+{
+	if (m_state && !m_state->done.exchange(true))
+	{
+		PostToolReply(m_state->call, nullptr, message);
+	}
+}
+
+void McpServer::McpProgress::Report(double progress, double total, const char* message) const
+{
+	if (!m_state)
+	{
+		return;
+	}
+	bool post = false;
+	{
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		if (m_state->finished)
+		{
+			return;
+		}
+		m_state->progress = progress;
+		m_state->total = total;
+		m_state->message = message != nullptr ? message : "";
+		m_state->pending = true;
+		if (!m_state->scheduled)
+		{
+			m_state->scheduled = true;
+			post = true;
+		}
+	}
+	if (post)
+	{
+		PostProgress(m_state->loop, m_state);
+	}
+}
+
+void McpServer::cbToolsCall(void* rpc_req)
+{
+	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
+	McpServer* self = ((McpRequest*)r->req_data)->server;
+
+	McpRequest* req = (McpRequest*)r->req_data;
+
+	// Look up name and arguments inside the pre-located params slice only
+	struct mg_str params = req != nullptr ? req->params : mg_str_n(nullptr, 0);
+	if (req == nullptr)
+	{
+		int len, off = mg_json_get(r->frame, "$.params", &len);
+		if (off > 0)
+		{
+			params = mg_str_n(&r->frame.buf[off], (size_t)len);
+		}
+	}
+
+	char* name = ArenaJsonStr(
+		params, 
+		"$.name"
+	);
+
+	auto it = name != nullptr ? self->m_tools.find(std::string_view(name)) : self->m_tools.end();
+	if (it == self->m_tools.end())
+	{
+		mg_json_rpc2_err(r, -32602, "\"Unknown tool: invalid_tool_name\"");
+		return;
+	}
+
+	struct mg_str args = mg_str_n(nullptr, 0);
+	int args_len, args_off = mg_json_get(params, "$.arguments", &args_len);
+	if (args_off > 0)
+	{
+		args = mg_str_n(&params.buf[args_off], (size_t)args_len);
+	}
+
+	McpTool& tool = it->second;
+	auto arguments = std::make_shared<McpArguments>();
+	if (!ExtractArguments(r, tool, args.buf, args.len, *arguments))
+	{
+		return;
+	}
+
+	// Streaming, asynchronous and coroutine tools reply through the
+	// connection, which only an HTTP request has
+	if ((tool.stream_callback || tool.async_callback) && req == nullptr)
+	{
+		mg_json_rpc2_err(r, -32603, "\"Tool needs an HTTP request\"");
+		return;
+	}
+	if (req == nullptr || (!tool.async_callback && !tool.stream_callback && self->m_workers.empty()))
+	{
+		WriteToolResult(r, tool, tool.callback(*arguments));
+		return;
+	}
+
+	// Progress goes out on the response stream, which a streaming tool
+	// already uses for its result
+	int token_len, token_off = mg_json_get(params, "$._meta.progressToken", &token_len);
+	if (token_off > 0 && !tool.stream_callback)
+	{
+		auto progress = std::make_shared<McpProgress::State>();
+		progress->loop = (McpLoop*)req->loop;
+		progress->connection_id = req->connection_id;
+		progress->session_id.assign(req->session_id.buf, req->session_id.len);
+		progress->token.assign(&params.buf[token_off], (size_t)token_len);
+		progress->interval = self->m_progress_interval;
+		arguments->m_progress.m_state = progress;
+		progress->loop->progress_calls[req->connection_id] = progress;
+	}
+
+	auto cancellation = std::make_shared<McpCancellation>();
+	cancellation->loop = (McpLoop*)req->loop;
+	cancellation->connection_id = req->connection_id;
+	cancellation->key = CancellationKey(std::string_view(req->session_id.buf, req->session_id.len), std::string_view(req->id.buf, req->id.len));
+	arguments->m_cancellation = cancellation;
+	{
+		std::lock_guard<std::mutex> lock(self->m_cancel_mutex);
+		self->m_cancellations[cancellation->key] = cancellation;
+	}
+
+	// Only the request id is copied, the rest of hm->body is not needed once
+	// the arguments are extracted
+	req->deferred = true;
+	McpPendingCall call = {
+		self,
+		&tool,
+		(McpLoop*)req->loop,
+		req->connection_id,
+		std::string(req->session_id.buf, req->session_id.len),
+		std::string(req->id.buf, req->id.len),
+		std::move(arguments),
+		std::move(cancellation)
+	};
+
+	if (tool.stream_callback)
+	{
+		StreamToolResult(std::move(call));
+		return;
+	}
+
+	if (tool.async_callback)
+	{
+		McpCompletion completion;
+		completion.m_state = std::make_shared<McpCompletion::State>(std::move(call));
+		try
+		{
+			tool.async_callback(*completion.m_state->call.arguments, completion);
+		}
+		catch (...)
+		{
+			completion.Fail("Internal error");
+		}
+		return;
+	}
+
+	// Run the callback on the worker pool
+	self->PostJob(
+		[call = std::move(call)]()
+		{
+			// Cancelled while queued: the work never starts
+			if (call.cancellation->source.stop_requested())
+			{
+				return;
+			}
+			std::vector<McpContent> contents;
+			try
+			{
+				contents = call.tool->callback(*call.arguments);
+			}
+			catch (...)
+			{
+				PostToolReply(call, nullptr, "Internal error");
+				return;
+			}
+			PostToolReply(call, &contents, nullptr);
+		}
+	);
+}
+
+void McpServer::WriteContentItem(McpJsonWriter& writer, const McpContent& content)
+{
+	if (!content.mime_type.empty())
+	{
+		// Encoded straight into the reply buffer
+		bool audio = content.mime_type.compare(0, 6, "audio/") == 0;
+		writer.Raw(audio ? "{\"type\": \"audio\",\"data\": \"" : "{\"type\": \"image\",\"data\": \"");
+		writer.Base64(content.value.data(), content.value.size());
+		writer.Raw("\",\"mimeType\": ");
+		writer.String(content.mime_type);
+		writer.Raw("}");
+		return;
+	}
+	writer.Raw("{\"type\": \"");
+	writer.Raw(GetPropertyType(content.property_type));
+	writer.Raw("\",\"text\": ");
+	writer.String(content.value);
+	writer.Raw("}");
+}
+
+void McpServer::WriteStructuredRow(McpJsonWriter& writer, const McpTool& tool, const McpContent& content)
+{
+	writer.Raw("{");
+	bool first = true;
+	for (const auto& value : content.properties)
+	{
+		int index = tool.outputs.Find(value.property_name);
+		if (index < 0)
+		{
+			continue;
+		}
+		if (!first) 
+		{
+			writer.Raw(",");
+		}
+		first = false;
+		writer.Raw(tool.output_keys[index]);
+		WritePropertyValue(writer, tool.output_types[index], value);
+	}
+	writer.Raw("}");
+}
+
+// A chunk of a chunked transfer body: the size is written as a fixed-width
+// placeholder and filled in once the data is in place, so the JSON goes
+// straight into the send buffer
+static size_t BeginChunk(struct mg_iobuf* io)
+{
+	McpJsonWriter(io).Raw("00000000\r\n", 10);
+	return io->len;
+}
+
+static void EndChunk(struct mg_iobuf* io, size_t data)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t len = io->len - data;
+	for (int i = 0; i < 8; i++)
+	{
+		io->buf[data - 3 - i] = (unsigned char)hex[len & 0x0f];
+		len >>= 4;
+	}
+	McpJsonWriter(io).Raw("\r\n", 2);
+}
+
+// Headers of an SSE reply whose body is sent in chunks as it is produced
+static void WriteChunkedHeaders(struct mg_connection* conn, std::string_view session_id)
+{
+	mg_printf(conn,
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/event-stream\r\n"
+		"mcp-session-id: %.*s\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"\r\n",
+		(int)session_id.size(), session_id.data()
+	);
+}
+
+McpServer::McpResultStream::McpWrite McpServer::McpResultStream::Write(const McpContent& content)
+{
+	mg_connection* conn = (mg_connection*)m_connection;
+	if (conn == nullptr)
+	{
+		return McpWrite(this, false);
+	}
+
+	struct mg_iobuf* io = &conn->send;
+	size_t start = io->len;
+	try
+	{
+		size_t data = BeginChunk(io);
+		McpJsonWriter writer(io);
+		if (m_items > 0)
+		{
+			writer.Raw(",");
+		}
+		if (m_tool->output_schema.size() == 0)
+		{
+			WriteContentItem(writer, content);
+		}
+		else
+		{
+			WriteStructuredRow(writer, *m_tool, content);
+		}
+		EndChunk(io, data);
+	}
+	catch (...)
+	{
+		// Never leave a partial chunk behind
+		io->len = start;
+		throw;
+	}
+	m_items++;
+	m_server->m_stat_response_bytes += io->len - start;
+	return McpWrite(this, io->len > m_server->m_streaming_window);
+}
+
+McpDetachedTask McpServer::StreamToolResult(McpPendingCall call)
+{
+	// Start from the loop's resume queue, once cbEvHander has rolled back
+	// the buffered reply
+	co_await Await<bool>([](std::function<void(bool)> done) { done(true); });
+
+	McpLoop* loop = call.loop;
+	mg_connection* conn = ((mg_mgr*)loop->mgr)->conns;
+	while (conn != nullptr && conn->id != call.connection_id)
+	{
+		conn = conn->next;
+	}
+	if (conn == nullptr)
+	{
+		// The client left before the stream started
+		call.cancellation->replied = true;
+		call.server->EndCancellation(call.cancellation);
+		EndProgress(loop, call.connection_id);
+		co_return;
+	}
+
+	McpServer* self = call.server;
+	const McpTool& tool = *call.tool;
+	bool structured = tool.output_schema.size() != 0;
+	McpResultStream stream;
+	stream.m_server = self;
+	stream.m_tool = &tool;
+	stream.m_connection = conn;
+	stream.m_stop_token = call.cancellation->source.get_token();
+	stream.m_items = 0;
+	loop->results[conn->id] = &stream;
+
+	// Structured rows go first so that the content array, which only holds
+	// an error if there is one, can follow without buffering them. The text
+	// mirror would need the whole result and is left out.
+	size_t start = conn->send.len;
+	WriteChunkedHeaders(conn, call.session_id);
+	size_t data = BeginChunk(&conn->send);
+	McpJsonWriter writer(&conn->send);
+	writer.Raw("event: message\ndata: {\"jsonrpc\":\"2.0\",\"id\":");
+	writer.Raw(call.id);
+	writer.Raw(structured ? ",\"result\":{\"structuredContent\": {\"content\": [" : ",\"result\":{\"content\": [");
+	EndChunk(&conn->send, data);
+	self->m_stat_response_bytes += conn->send.len - start;
+
+	std::string error;
+	bool failed = false;
+	try
+	{
+		co_await tool.stream_callback(*call.arguments, stream);
+	}
+	catch (const std::exception& e)
+	{
+		error = e.what();
+		failed = true;
+	}
+	catch (...)
+	{
+		error = "Internal error";
+		failed = true;
+	}
+
+	conn = (mg_connection*)stream.m_connection;
+	bool cancelled = call.cancellation->replied.exchange(true);
+	self->EndCancellation(call.cancellation);
+	EndProgress(loop, call.connection_id);
+	if (conn != nullptr && cancelled)
+	{
+		// The result is cut short, so the connection cannot be reused
+		conn->is_draining = 1;
+		loop->results.erase(conn->id);
+	}
+	else if (conn != nullptr)
+	{
+		// A failure after the headers went out ends the result with
+		// isError and the message as its text content
+		start = conn->send.len;
+		data = BeginChunk(&conn->send);
+		if (structured)
+		{
+			writer.Raw("]}, \"content\": [");
+		}
+		else if (failed && stream.m_items > 0)
+		{
+			writer.Raw(",");
+		}
+		if (failed)
+		{
+			writer.Raw("{\"type\": \"text\",\"text\": ");
+			writer.String(error);
+			writer.Raw("}]");
+			writer.Raw(", \"isError\": true}}\n\n");
+		}
+		else
+		{
+			writer.Raw("]}}\n\n");
+		}
+		EndChunk(&conn->send, data);
+		mg_send(conn, "0\r\n\r\n", 5);
+		self->m_stat_response_bytes += conn->send.len - start;
+		conn->is_resp = 0;
+		loop->results.erase(conn->id);
+	}
+}
+
+void McpServer::AddStreamingTool(
+	const char* tool_name, 
+	const char* tool_description, 
+	const std::vector<McpProperty>& input_schema,
+	const std::vector<McpProperty>& output_schema,
+	std::function <McpTask<void>(const McpArguments& args, McpResultStream& stream)> handler
+)
+{
+	McpTool& tool = DefineTool(tool_name, tool_description, input_schema, output_schema);
+	tool.stream_callback = handler;
+}
+
+void McpServer::SetStreamingWindow(size_t bytes)
+{
+	m_streaming_window = bytes;
+}
+
+void McpServer::SetProgressInterval(uint64_t milliseconds)
+{
+	m_progress_interval = milliseconds;
+}
+
+void McpServer::PostProgress(McpLoop* loop, std::shared_ptr<McpProgress::State> state)
+{
+	bool wakeup;
+	{
+		std::lock_guard<std::mutex> lock(loop->reply_mutex);
+		wakeup = loop->Idle();
+		loop->progress.push_back(std::move(state));
+	}
+	if (wakeup)
+	{
+		mg_wakeup((mg_mgr*)loop->mgr, loop->wakeup_id, "", 0);
+	}
+}
+
+void McpServer::FlushProgress(McpLoop* loop)
+{
+	std::vector<std::shared_ptr<McpProgress::State>> progress;
+	{
+		std::lock_guard<std::mutex> lock(loop->reply_mutex);
+		progress.swap(loop->progress);
+	}
+	for (auto& state : progress)
+	{
+		SendProgress(loop, state);
+	}
+}
+
+// Sends the latest report of a call, or, within the interval of the last
+// one, sets a timer to send whatever is latest when the interval is over
+void McpServer::SendProgress(McpLoop* loop, const std::shared_ptr<McpProgress::State>& state)
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	if (state->finished || !state->pending)
+	{
+		state->scheduled = false;
+		return;
+	}
+
+	mg_mgr* mgr = (mg_mgr*)loop->mgr;
+	uint64_t now = mg_millis();
+	if (state->started && now < state->last_sent + state->interval)
+	{
+		auto timer_state = new std::shared_ptr<McpProgress::State>(state);
+		struct mg_timer* timer = mg_timer_add(mgr, state->last_sent + state->interval - now, MG_TIMER_ONCE, [](void* arg)
+		{
+			std::shared_ptr<McpProgress::State>* state = (std::shared_ptr<McpProgress::State>*)arg;
+			SendProgress((*state)->loop, *state);
+			delete state;
+		}, timer_state);
+		if (timer != nullptr)
+		{
+			timer->expire = state->last_sent + state->interval;
+			return;
+		}
+		// Without a timer the report goes out early rather than never
+		delete timer_state;
+	}
+
+	mg_connection* conn = mgr->conns;
+	while (conn != nullptr && conn->id != state->connection_id)
+	{
+		conn = conn->next;
+	}
+	if (conn == nullptr)
+	{
+		state->finished = true;
+		return;
+	}
+
+	// The first report turns the reply into a chunked SSE stream
+	struct mg_iobuf* io = &conn->send;
+	size_t start = io->len;
+	if (!state->started)
+	{
+		WriteChunkedHeaders(conn, state->session_id);
+		state->started = true;
+	}
+	size_t data = BeginChunk(io);
+	McpJsonWriter writer(io);
+	writer.Raw("event: message\ndata: {\"jsonrpc\":\"2.0\",\"method\":\"notifications/progress\",\"params\":{\"progressToken\":");
+	writer.Raw(state->token);
+	writer.Raw(",\"progress\":");
+	writer.Number(state->progress);
+	if (state->total > 0)
+	{
+		writer.Raw(",\"total\":");
+		writer.Number(state->total);
+	}
+	if (!state->message.empty())
+	{
+		writer.Raw(",\"message\":");
+		writer.String(state->message);
+	}
+	writer.Raw("}}\n\n");
+	EndChunk(io, data);
+	((McpServer*)conn->fn_data)->m_stat_response_bytes += io->len - start;
+
+	state->last_sent = now;
+	state->pending = false;
+	state->scheduled = false;
+}
+
+// Stops progress reports for the call on a connection once it has replied
+// or closed; true if reports had already turned the reply into chunks
+bool McpServer::EndProgress(McpLoop* loop, unsigned long connection_id)
+{
+	auto progress = loop->progress_calls.find(connection_id);
+	if (progress == loop->progress_calls.end())
+	{
+		return false;
+	}
+	bool started;
+	{
+		std::lock_guard<std::mutex> lock(progress->second->mutex);
+		progress->second->finished = true;
+		started = progress->second->started;
+	}
+	loop->progress_calls.erase(progress);
+	return started;
+}
+
+void McpServer::WriteToolResult(void* rpc_req, const McpTool& tool, const std::vector<McpContent>& contents)
+{
+	struct mg_rpc_req* r = (struct mg_rpc_req*)rpc_req;
+	struct mg_iobuf* io = (struct mg_iobuf*)r->pfn_data;
+	McpRequest* req = (McpRequest*)r->req_data;
+
+	// Reserve what this tool needed last time so large results don't regrow
+	size_t start = io->len;
+	size_t hint = tool.reply_size_hint.load(std::memory_order_relaxed);
+	if (io->size < start + hint + 1)
+	{
+		mg_iobuf_resize(io, start + hint + 1);
+	}
+
+	// SSE frame and JSON-RPC envelope around the result, written in place
+	McpJsonWriter writer(io);
+	writer.Raw("event: message\ndata: {\"jsonrpc\":\"2.0\",\"id\":");
+	writer.Raw(req->id.buf, req->id.len);
+	writer.Raw(",\"result\":{\"content\": [");
+
+	if (tool.output_schema.size() == 0)
+	{
+		for (size_t i = 0; i < contents.size(); i++)
+		{
+			if (i > 0) {
+				writer.Raw(",");
+			}
+			WriteContentItem(writer, contents[i]);
+		}
+		writer.Raw("]}");
+	}
+	else
+	{
+		// Structured rows are encoded once into scratch space; the text
+		// mirror is the same bytes escape-copied into a string
+		struct mg_iobuf* rows = &s_rows.io;
+		rows->len = 0;
+		McpJsonWriter row_writer(rows);
+		for (size_t i = 0; i < contents.size(); i++)
+		{
+			if (i > 0) 
+			{
+				row_writer.Raw(",");
+			}
+			size_t row_start = rows->len;
+			WriteStructuredRow(row_writer, tool, contents[i]);
+
+			if (tool.text_mirror)
+			{
+				if (i > 0)
+				{
+					writer.Raw(",");
+				}
+				writer.Raw("{\"type\": \"text\",\"text\": \"");
+				writer.Escape(std::string_view((const char*)rows->buf + row_start, rows->len - row_start));
+				writer.Raw("\"}");
+			}
+		}
+		writer.Raw("], \"structuredContent\": {\"content\": [");
+		writer.Raw((const char*)rows->buf, rows->len);
+		writer.Raw("]}}");
+		if (rows->size > REPLY_BUFFER_POOL_MAX_SIZE)
+		{
+			mg_iobuf_free(rows);
+		}
+	}
+
+	writer.Raw("}\n\n");
+
+	tool.reply_size_hint.store(io->len - start, std::memory_order_relaxed);
+}
+
+void McpServer::SetWorkerThreads(size_t worker_threads)
+{
+	m_worker_threads = worker_threads;
+}
+
+void McpServer::SetGeometricConnectionBuffers(bool geometric)
+{
+	m_geometric_connection_buffers = geometric;
+}
+
+McpServer::BufferStats McpServer::GetBufferStats() const
+{
+	return BufferStats{
+		m_stat_requests.load(),
+		m_stat_allocations.load(),
+		m_stat_bytes_copied.load(),
+		m_stat_response_bytes.load()
+	};
+}
+
+void McpServer::StartWorkers()
+{
+	m_workers_stop = false;
+	for (size_t i = 0; i < m_worker_threads; i++)
+	{
+		m_workers.emplace_back(&McpServer::WorkerThread, this);
+	}
+}
+
+void McpServer::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_job_mutex);
+		m_workers_stop = true;
+	}
+	m_job_cv.notify_all();
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+}
+
+void McpServer::WorkerThread()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_job_mutex);
+			m_job_cv.wait(lock, [this] { return m_workers_stop || !m_jobs.empty(); });
+			if (m_jobs.empty())
+			{
+				return;
+			}
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void McpServer::PostJob(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_job_mutex);
+		m_jobs.push_back(std::move(job));
+	}
+	m_job_cv.notify_one();
+}
+
+void McpServer::PostReply(McpLoop* loop, McpReply reply)
+{
+	bool wakeup;
+	{
+		std::lock_guard<std::mutex> lock(loop->reply_mutex);
+		wakeup = loop->Idle();
+		loop->replies.push_back(std::move(reply));
+	}
+	// One pending wakeup is enough, FlushReplies() drains the whole queue
+	if (wakeup)
+	{
+		mg_wakeup((mg_mgr*)loop->mgr, loop->wakeup_id, "", 0);
+	}
+}
+
+void* McpServer::CurrentLoop()
+{
+	return s_current_loop;
+}
+
+// Queues a coroutine to be resumed by its event loop. From the loop's own
+// thread no wakeup is needed, the poll loop drains the queue after polling.
+void McpServer::ResumeOnLoop(void* loop_ptr, std::coroutine_handle<> handle)
+{
+	McpLoop* loop = (McpLoop*)loop_ptr;
+	bool wakeup;
+	{
+		std::lock_guard<std::mutex> lock(loop->reply_mutex);
+		wakeup = loop->Idle() && s_current_loop != loop;
+		loop->resumes.push_back(handle);
+	}
+	if (wakeup)
+	{
+		mg_wakeup((mg_mgr*)loop->mgr, loop->wakeup_id, "", 0);
+	}
+}
+
+void McpServer::RunResumes(McpLoop* loop)
+{
+	std::vector<std::coroutine_handle<>> resumes;
+	for (;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(loop->reply_mutex);
+			if (loop->resumes.empty())
+			{
+				break;
+			}
+			resumes.swap(loop->resumes);
+		}
+		for (auto handle : resumes)
+		{
+			McpArenaScope arena_scope;
+			handle.resume();
+		}
+		resumes.clear();
+	}
+}
+
+bool McpServer::McpSleep::await_suspend(std::coroutine_handle<> handle)
+{
+	McpLoop* loop = (McpLoop*)CurrentLoop();
+	struct McpSleepTimer {
+		McpLoop* loop;
+		std::coroutine_handle<> handle;
+	};
+	// Resumed through the queue rather than from inside the timer list walk
+	McpSleepTimer* sleep_timer = new McpSleepTimer{ loop, handle };
+	struct mg_timer* timer = mg_timer_add((mg_mgr*)loop->mgr, m_milliseconds, MG_TIMER_ONCE, [](void* arg)
+	{
+		McpSleepTimer* timer = (McpSleepTimer*)arg;
+		ResumeOnLoop(timer->loop, timer->handle);
+		delete timer;
+	}, sleep_timer);
+	if (timer == nullptr)
+	{
+		delete sleep_timer;
+		return false;
+	}
+	// Count from now rather than from the next poll
+	timer->expire = mg_millis() + m_milliseconds;
+	return true;
+}
+
+void McpServer::McpFetch::await_suspend(std::coroutine_handle<> handle)
+{
+	m_handle = handle;
+	m_loop = CurrentLoop();
+	m_deadline = mg_millis() + m_timeout;
+	mg_connection* conn = mg_http_connect((mg_mgr*)((McpLoop*)m_loop)->mgr, m_url.c_str(), (mg_event_handler_t)cbFetch, this);
+	if (conn == nullptr)
+	{
+		ResumeOnLoop(m_loop, m_handle);
+	}
+}
+
+void McpServer::cbFetch(void* connection, int event_code, void* event_data)
+{
+	mg_connection* conn = (mg_connection*)connection;
+	McpFetch* fetch = (McpFetch*)conn->fn_data;
+	if (fetch == nullptr)
+	{
+		return;
+	}
+
+	if (event_code == MG_EV_CONNECT)
+	{
+		struct mg_str host = mg_url_host(fetch->m_url.c_str());
+		if (mg_url_is_ssl(fetch->m_url.c_str()))
+		{
+			struct mg_tls_opts opts = { .ca = mg_str_n(fetch->m_ca.data(), fetch->m_ca.size()), .name = host };
+			mg_tls_init(conn, &opts);
+		}
+		mg_printf(conn,
+			"%s %s HTTP/1.1\r\n"
+			"Host: %.*s\r\n"
+			"Content-Length: %lu\r\n"
+			"%s"
+			"\r\n",
+			fetch->m_method.c_str(),
+			mg_url_uri(fetch->m_url.c_str()),
+			(int)host.len, host.buf,
+			(unsigned long)fetch->m_body.size(),
+			fetch->m_headers.c_str()
 		);
+		mg_send(conn, fetch->m_body.data(), fetch->m_body.size());
+		return;
 	}
-	else
+
+	if (event_code == MG_EV_POLL)
 	{
-		for (size_t i = 0; i < contents.size(); i++)
+		if (mg_millis() < fetch->m_deadline)
 		{
-			if (i > 0) 
+			return;
+		}
+		fetch->m_response.status = 0;
+		fetch->m_response.body = "timed out";
+		conn->is_closing = 1;
+	}
+	else if (event_code == MG_EV_HTTP_MSG)
+	{
+		struct mg_http_message* hm = (struct mg_http_message*)event_data;
+		fetch->m_response.status = mg_http_status(hm);
+		fetch->m_response.body.assign(hm->body.buf, hm->body.len);
+		conn->is_draining = 1;
+	}
+	else if (event_code == MG_EV_ERROR)
+	{
+		fetch->m_response.status = 0;
+		fetch->m_response.body = (const char*)event_data;
+	}
+	else if (event_code != MG_EV_CLOSE)
+	{
+		return;
+	}
+
+	// The awaiter goes away once the coroutine resumes; detach it first
+	conn->fn_data = nullptr;
+	ResumeOnLoop(fetch->m_loop, fetch->m_handle);
+}
+
+void McpServer::PostStreamFlush(McpLoop* loop, std::shared_ptr<McpEventStream> stream, unsigned long connection_id)
+{
+	bool wakeup;
+	{
+		std::lock_guard<std::mutex> lock(loop->reply_mutex);
+		wakeup = loop->Idle();
+		loop->streams.push_back({ std::move(stream), connection_id });
+	}
+	if (wakeup)
+	{
+		mg_wakeup((mg_mgr*)loop->mgr, loop->wakeup_id, "", 0);
+	}
+}
+
+void McpServer::FlushStreams(McpLoop* loop)
+{
+	std::vector<McpLoop::McpStreamFlush> streams;
+	{
+		std::lock_guard<std::mutex> lock(loop->reply_mutex);
+		streams.swap(loop->streams);
+	}
+
+	mg_mgr* mgr = (mg_mgr*)loop->mgr;
+	for (auto& flush : streams)
+	{
+		mg_connection* conn = mgr->conns;
+		while (conn != nullptr && conn->id != flush.connection_id)
+		{
+			conn = conn->next;
+		}
+
+		McpEventStream& stream = *flush.stream;
+		std::lock_guard<std::mutex> lock(stream.mutex);
+		bool current = stream.connection_id == flush.connection_id && stream.loop == loop;
+		if (current)
+		{
+			stream.queued = false;
+		}
+		if (conn == nullptr)
+		{
+			continue;
+		}
+		if (current && !stream.closed)
+		{
+			WriteEvents(conn, stream);
+		}
+		else
+		{
+			// Replaced by a newer GET, or the session is gone. With nothing
+			// left to send the poll would not wake up for a draining close.
+			if (conn->send.len == 0)
+			{
+				conn->is_closing = 1;
+			}
+			else
 			{
-				content_json += ",";
-				structured_content_json += ",";
+				conn->is_draining = 1;
 			}
-			content_json += "{\"type\": \"text\",\"text\": \"{";
-			structured_content_json += "{";
-			for (size_t j = 0; j < contents[i].properties.size(); j++)
+		}
+	}
+}
+
+void McpServer::FlushReplies(McpLoop* loop)
+{
+	RunResumes(loop);
+	FlushStreams(loop);
+	FlushProgress(loop);
+
+	std::deque<McpReply> replies;
+	{
+		std::lock_guard<std::mutex> lock(loop->reply_mutex);
+		replies.swap(loop->replies);
+	}
+
+	mg_mgr* mgr = (mg_mgr*)loop->mgr;
+	for (auto& reply : replies)
+	{
+		struct mg_iobuf io = { reply.buf, reply.size, reply.len, 1024, true };
+
+		// Progress ends with the reply; if any was sent, the reply body
+		// becomes the last chunk of the stream
+		bool chunked = EndProgress(loop, reply.connection_id);
+
+		for (mg_connection* conn = mgr->conns; conn != nullptr; conn = conn->next)
+		{
+			if (conn->id == reply.connection_id)
 			{
-				if (j > 0) 
+				McpServer* self = (McpServer*)conn->fn_data;
+				if (loop->results.find(conn->id) != loop->results.end())
+				{
+					// Only a cancellation replies to a streaming call; its
+					// result is already partly sent, so the connection goes
+					if (conn->send.len == 0)
+					{
+						conn->is_closing = 1;
+					}
+					else
+					{
+						conn->is_draining = 1;
+					}
+					break;
+				}
+				if (chunked)
+				{
+					std::string_view response((const char*)io.buf, io.len);
+					size_t body = response.find("\r\n\r\n");
+					body = body != std::string_view::npos ? body + 4 : io.len;
+					McpJsonWriter writer(&conn->send);
+					if (body < io.len)
+					{
+						size_t data = BeginChunk(&conn->send);
+						writer.Raw(response.substr(body));
+						EndChunk(&conn->send, data);
+					}
+					writer.Raw("0\r\n\r\n", 5);
+					self->m_stat_bytes_copied += io.len - body;
+				}
+				else if (conn->send.len == 0)
+				{
+					// Nothing queued yet: the reply buffer becomes the send
+					// buffer and the connection's empty one goes to the pool
+					std::swap(conn->send.buf, io.buf);
+					std::swap(conn->send.size, io.size);
+					conn->send.len = io.len;
+					io.len = 0;
+				}
+				else
 				{
-					content_json += ",";
-					structured_content_json += ",";
+					mg_send(conn, io.buf, io.len);
+					self->m_stat_bytes_copied += io.len;
 				}
-				content_json += "\\\"" + contents[i].properties[j].property_name + "\\\": " + self->GetPropertyValue(tool, contents[i].properties[j], true);
-				structured_content_json += "\"" + contents[i].properties[j].property_name + "\": " + self->GetPropertyValue(tool, contents[i].properties[j], false);
+				conn->is_resp = 0;
+				self->m_stat_response_bytes += reply.len;
+				break;
 			}
-			content_json += "}\"";
-			content_json += "}";
-			structured_content_json += "}";
 		}
-
-		mg_json_rpc2_ok(
-			r,
-			"{\"content\": [%s], \"structuredContent\": {\"content\": [%s]}}",
-			content_json.c_str(),
-			structured_content_json.c_str()
-		);
+		ReleaseReplyBuffer(&io);
 	}
 }
 
@@ -579,6 +2914,35 @@ void McpServer::SetAuthorization(const char* authorization_servers, const char*
 	}
 }
 
+void McpServer::SetJwks(const char* source, const char* issuer, uint64_t refresh_interval, const char* ca_file)
+{
+	m_jwks_source = source != nullptr ? source : "";
+	m_jwks_issuer = issuer != nullptr ? issuer : "";
+	m_jwks_refresh_interval = refresh_interval;
+	m_jwks_ca.clear();
+	if (ca_file != nullptr)
+	{
+		struct mg_str ca = mg_file_read(&mg_fs_posix, ca_file);
+		if (ca.buf == nullptr)
+		{
+			MG_ERROR(("JWKS CA file %s not loaded", ca_file));
+			return;
+		}
+		m_jwks_ca.assign(ca.buf, ca.len);
+		mg_free((void*)ca.buf);
+	}
+}
+
+void McpServer::SetTokenCacheSize(size_t entries)
+{
+	m_token_cache.SetCapacity(entries);
+}
+
+McpTokenCache::Stats McpServer::GetTokenCacheStats() const
+{
+	return m_token_cache.GetStats();
+}
+
 void McpServer::AddTool(
 	const char* tool_name, 
 	const char* tool_description, 
@@ -587,59 +2951,378 @@ void McpServer::AddTool(
 	std::function <std::vector<McpContent>(const std::map<std::string, std::string>& args)> callback
 )
 {
-	McpTool tool;
+	AddTool(
+		tool_name,
+		tool_description,
+		input_schema,
+		output_schema,
+		[callback](const McpArguments& args) -> std::vector<McpContent> {
+			std::map<std::string, std::string> map_args;
+			for (size_t i = 0; i < args.Size(); i++)
+			{
+				map_args[args.Name(i)] = std::string(args[i].AsString());
+			}
+			return callback(map_args);
+		}
+	);
+}
+
+McpServer::McpTool& McpServer::DefineTool(
+	const char* tool_name, 
+	const char* tool_description, 
+	const std::vector<McpProperty>& input_schema,
+	const std::vector<McpProperty>& output_schema
+)
+{
+	McpTool& tool = m_tools[tool_name];
 	tool.name = tool_name;
 	tool.description = tool_description;
+	tool.input_schema.clear();
+	tool.output_schema.clear();
+	tool.arguments = McpNameIndex();
+	tool.required.clear();
+	tool.types.clear();
+	// A property defined twice keeps its first position and its last
+	// definition, as the schema maps do. The indexes are only built after
+	// the loops, so positions are looked up by name.
+	auto position = [](const std::vector<std::string>& names, const std::string& name) {
+		return (size_t)(std::find(names.begin(), names.end(), name) - names.begin());
+	};
 	for (auto it = input_schema.begin(); it != input_schema.end(); it++)
 	{
+		size_t i = position(tool.arguments.names, it->property_name);
+		if (i == tool.arguments.names.size())
+		{
+			tool.arguments.names.push_back(it->property_name);
+			tool.required.push_back(it->required);
+			tool.types.push_back(it->property_type);
+		}
+		else
+		{
+			tool.required[i] = it->required;
+			tool.types[i] = it->property_type;
+		}
 		tool.input_schema[it->property_name] = *it;
 	}
+	tool.arguments.Build();
+	tool.outputs = McpNameIndex();
+	tool.output_keys.clear();
+	tool.output_types.clear();
 	for (auto it = output_schema.begin(); it != output_schema.end(); it++)
 	{
+		size_t i = position(tool.outputs.names, it->property_name);
+		if (i == tool.outputs.names.size())
+		{
+			struct mg_iobuf io = { 0, 0, 0, 64, false };
+			McpJsonWriter key(&io);
+			key.String(it->property_name);
+			key.Raw(": ");
+			tool.outputs.names.push_back(it->property_name);
+			tool.output_keys.push_back(std::string((char*)io.buf, io.len));
+			tool.output_types.push_back(it->property_type);
+			mg_iobuf_free(&io);
+		}
+		else
+		{
+			tool.output_types[i] = it->property_type;
+		}
 		tool.output_schema[it->property_name] = *it;
 	}
+	tool.outputs.Build();
+	tool.text_mirror = true;
+	tool.reply_size_hint = 0;
+	// A redefined tool runs only the handler registered last
+	tool.callback = nullptr;
+	tool.async_callback = nullptr;
+	tool.stream_callback = nullptr;
+
+	InvalidateResultCache();
+	return tool;
+}
+
+void McpServer::AddTool(
+	const char* tool_name, 
+	const char* tool_description, 
+	const std::vector<McpProperty>& input_schema,
+	const std::vector<McpProperty>& output_schema,
+	std::function <std::vector<McpContent>(const McpArguments& args)> callback
+)
+{
+	McpTool& tool = DefineTool(tool_name, tool_description, input_schema, output_schema);
 	tool.callback = callback;
-	m_tools[tool_name] = tool;
 }
 
-bool McpServer::Run(const char* url, uint64_t session_timeout)
+void McpServer::AddAsyncTool(
+	const char* tool_name, 
+	const char* tool_description, 
+	const std::vector<McpProperty>& input_schema,
+	const std::vector<McpProperty>& output_schema,
+	std::function <void(const McpArguments& args, McpCompletion completion)> callback
+)
+{
+	McpTool& tool = DefineTool(tool_name, tool_description, input_schema, output_schema);
+	tool.async_callback = callback;
+}
+
+// Drives a tool coroutine and completes the call with its result
+static McpDetachedTask RunToolTask(McpTask<std::vector<McpServer::McpContent>> task, McpServer::McpCompletion completion)
+{
+	try
+	{
+		completion.Complete(co_await task);
+	}
+	catch (const std::exception& e)
+	{
+		completion.Fail(e.what());
+	}
+	catch (...)
+	{
+		completion.Fail("Internal error");
+	}
+}
+
+void McpServer::AddCoroutineTool(
+	const char* tool_name, 
+	const char* tool_description, 
+	const std::vector<McpProperty>& input_schema,
+	const std::vector<McpProperty>& output_schema,
+	std::function <McpTask<std::vector<McpContent>>(const McpArguments& args)> handler
+)
+{
+	AddAsyncTool(
+		tool_name,
+		tool_description,
+		input_schema,
+		output_schema,
+		[handler](const McpArguments& args, McpCompletion completion) {
+			RunToolTask(handler(args), completion);
+		}
+	);
+}
+
+void McpServer::SetToolTextMirror(const char* tool_name, bool enabled)
+{
+	auto it = m_tools.find(std::string_view(tool_name));
+	if (it != m_tools.end())
+	{
+		it->second.text_mirror = enabled;
+	}
+}
+
+void McpServer::SetToolsPageSize(size_t page_size)
+{
+	m_tools_page_size = page_size;
+	InvalidateResultCache();
+}
+
+void McpServer::InvalidateResultCache()
+{
+	std::lock_guard<std::mutex> lock(m_result_cache_mutex);
+	m_result_cache.reset();
+}
+
+bool McpServer::Run(const char* url, uint64_t session_timeout, size_t event_loops)
 {
 	if (!UpdateUrlPath(url))
 	{
 		return false;
 	}
 
-	struct mg_rpc* s_rpc_head = nullptr;
+	// Handshakes of the built-in TLS stack hash through mg_sha256 too
+	mg_sha256_set_blocks(McpSha256::Blocks);
 
-	struct mg_mgr mgr;
-	mg_mgr_init(&mgr);
+	if (!mg_url_is_ssl(url))
+	{
+		FreeTlsContext();
+	}
+	else if (!LoadTlsContext("cert.pem", "key.pem"))
+	{
+		return false;
+	}
 
-	struct mg_timer timer;
-	mg_timer_init(&mgr.timers, &timer, session_timeout, MG_TIMER_REPEAT, (mg_timer_handler_t)McpServer::cbTimerHandler, this);
+#if !defined(SO_REUSEPORT) || defined(SO_EXCLUSIVEADDRUSE)
+	// Without SO_REUSEPORT only one listener can own the port
+	event_loops = 1;
+#endif
+	if (event_loops == 0)
+	{
+		event_loops = 1;
+	}
 
-	mg_rpc_add(&s_rpc_head, mg_str("initialize"),		(mg_rpc_handler_t)McpServer::cbInitialize,		this);
-	mg_rpc_add(&s_rpc_head, mg_str("logging/setLevel"), (mg_rpc_handler_t)McpServer::cbLoggingSetLevel, this);
-	mg_rpc_add(&s_rpc_head, mg_str("tools/list"),		(mg_rpc_handler_t)McpServer::cbToolsList,		this);
-	mg_rpc_add(&s_rpc_head, mg_str("tools/call"),		(mg_rpc_handler_t)McpServer::cbToolsCall,		this);
+	m_method_index.names.clear();
+	m_methods.clear();
 
-	m_rpc_head = s_rpc_head;
+	AddMethod("initialize",					McpServer::cbInitialize,				false);
+	AddMethod("logging/setLevel",			McpServer::cbLoggingSetLevel,			false);
+	AddMethod("tools/list",					McpServer::cbToolsList,					false);
+	AddMethod("tools/call",					McpServer::cbToolsCall,					false);
+	AddMethod("notifications/initialized",	McpServer::cbNotificationsInitialized,	true);
+	AddMethod("notifications/cancelled",	McpServer::cbNotificationsCancelled,	true);
 
-	mg_http_listen(
-		&mgr, 
-		m_host.c_str(),
-		(mg_event_handler_t)cbEvHander,
-		this
-	);
+	m_method_index.Build();
+	BuildResultCache();
 
-	while (true)
+	// Each event loop owns a manager listening on the same port; the tool
+	// registry and the RPC table are shared read-only between them
+	std::vector<struct mg_mgr> mgrs(event_loops);
+	bool listening = true;
+	for (size_t i = 0; i < event_loops; i++)
+	{
+		struct mg_mgr& mgr = mgrs[i];
+		mg_mgr_init(&mgr);
+		mgr.reuseport = event_loops > 1;
+		mg_wakeup_init(&mgr);
+
+		auto loop = std::make_unique<McpLoop>();
+		loop->mgr = &mgr;
+		mgr.userdata = loop.get();
+		m_loops.push_back(std::move(loop));
+
+		mg_connection* listener = mg_http_listen(
+			&mgr, 
+			m_host.c_str(),
+			(mg_event_handler_t)cbEvHander,
+			this
+		);
+		if (listener == nullptr)
+		{
+			listening = false;
+			break;
+		}
+		m_loops[i]->wakeup_id = listener->id;
+	}
+
+	if (listening)
+	{
+		struct mg_timer timer;
+		mg_timer_init(&mgrs[0].timers, &timer, session_timeout, MG_TIMER_REPEAT, (mg_timer_handler_t)McpServer::cbTimerHandler, this);
+
+		// A JWKS file is loaded before the first request; a URL is fetched
+		// by the first timer run. With no refresh interval the document is
+		// read once and no timer stays behind.
+		struct mg_timer jwks_timer;
+		bool jwks_refresh = !m_jwks_source.empty() && m_jwks_refresh_interval > 0;
+		if (!m_jwks_source.empty())
+		{
+			bool url = IsHttpUrl(m_jwks_source);
+			if (!url)
+			{
+				try
+				{
+					m_key_set = LoadKeySet();
+				}
+				catch (const std::exception&)
+				{
+					MG_ERROR(("JWKS from %s not loaded", m_jwks_source.c_str()));
+				}
+			}
+			if (jwks_refresh)
+			{
+				mg_timer_init(&mgrs[0].timers, &jwks_timer, m_jwks_refresh_interval, MG_TIMER_REPEAT | (url ? MG_TIMER_RUN_NOW : 0), (mg_timer_handler_t)McpServer::cbJwksTimer, this);
+			}
+			else if (url)
+			{
+				// Freed by mongoose once it has run
+				if (mg_timer_add(&mgrs[0], 0, MG_TIMER_RUN_NOW, (mg_timer_handler_t)McpServer::cbJwksTimer, this) == nullptr)
+				{
+					MG_ERROR(("JWKS from %s not loaded", m_jwks_source.c_str()));
+				}
+			}
+		}
+
+		StartWorkers();
+
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < event_loops; i++)
+		{
+			threads.emplace_back([&mgr = mgrs[i], loop = m_loops[i].get()]()
+			{
+				s_current_loop = loop;
+				while (true)
+				{
+					mg_mgr_poll(&mgr, McpPollTimeout(&mgr, 1000));
+					RunResumes(loop);
+				}
+			});
+		}
+
+		s_current_loop = m_loops[0].get();
+		while (true)
+		{
+			mg_mgr_poll(&mgrs[0], McpPollTimeout(&mgrs[0], 1000));
+			RunResumes(m_loops[0].get());
+		}
+		s_current_loop = nullptr;
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		StopWorkers();
+		for (auto& loop : m_loops)
+		{
+			FlushReplies(loop.get());
+		}
+		mg_timer_free(&mgrs[0].timers, &timer);
+		if (jwks_refresh)
+		{
+			mg_timer_free(&mgrs[0].timers, &jwks_timer);
+		}
+	}
+
+	for (size_t i = 0; i < m_loops.size(); i++)
+	{
+		mg_mgr_free(&mgrs[i]);
+	}
+	m_loops.clear();
+
+	m_method_index = McpNameIndex();
+	m_methods.clear();
+
+	FreeTlsContext();
+
+	return listening;
+}
+
+bool McpServer::LoadTlsContext(const char* cert_file, const char* key_file)
+{
+	FreeTlsContext();
+
+	struct mg_str cert = mg_file_read(&mg_fs_posix, cert_file);
+	struct mg_str key = mg_file_read(&mg_fs_posix, key_file);
+	if (cert.buf == nullptr || key.buf == nullptr)
 	{
-		mg_mgr_poll(&mgr, 1000);
+		MG_ERROR(("TLS %s %s not loaded", cert.buf == nullptr ? "certificate" : "key", cert.buf == nullptr ? cert_file : key_file));
+		mg_free((void*)cert.buf);
+		mg_free((void*)key.buf);
+		return false;
 	}
+	m_tls_cert.assign(cert.buf, cert.len);
+	m_tls_key.assign(key.buf, key.len);
+	mg_free((void*)cert.buf);
+	mg_free((void*)key.buf);
+
+	// Parse the certificate chain and key once; accepted connections only
+	// create a per-connection SSL object from this context. Backends without
+	// shared context support return nullptr and parse m_tls_cert/m_tls_key
+	// per connection instead, which still avoids the file reads.
+	struct mg_tls_opts opts =
+	{
+		.cert = mg_str_n(m_tls_cert.data(), m_tls_cert.size()),
+		.key = mg_str_n(m_tls_key.data(), m_tls_key.size())
+	};
+	m_tls_shared = mg_tls_shared_new(&opts);
 
-	mg_rpc_del(&s_rpc_head, NULL);
-	m_rpc_head = nullptr;
+	return true;
+}
 
-	mg_mgr_free(&mgr);
+void McpServer::FreeTlsContext()
+{
+	mg_tls_shared_free(m_tls_shared);
+	m_tls_shared = nullptr;
+	m_tls_cert.clear();
+	m_tls_key.clear();
 }
 
 bool McpServer::UpdateUrlPath(const char* url)
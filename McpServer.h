@@ -17,20 +17,55 @@
 
 #pragma once
 
+#include "McpArena.h"
+#include "McpTask.h"
+#include "McpTokenCache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+class McpJsonWriter;
+
 class McpServer 
 {
+private:
+	// Exact-match name lookup through a seeded hash that gives every name its
+	// own slot, built once when the set of names is fixed
+	struct McpNameIndex {
+		std::vector<std::string> names;
+		std::vector<int> slots;
+		uint32_t seed;
+
+		void Build();
+		int Find(std::string_view name) const;
+	};
+
+	struct McpTool;
+	struct McpLoop;
+	struct McpCancellation;
+
 public:
 	McpServer(const char* server_name);
 
 	enum PropertyType {
 		PROPERTY_NUMBER = 1,
 		PROPERTY_STRING,
-		PROPERTY_OBJECT
+		PROPERTY_OBJECT,
+		PROPERTY_INTEGER,
+		PROPERTY_BOOLEAN,
+		PROPERTY_ARRAY
 	};
 	struct McpProperty {
 		std::string property_name;
@@ -38,14 +73,133 @@ public:
 		std::string description;
 		bool required;
 	};
+
+	// JSON value decoded once from the request. Strings and object keys are
+	// views into storage owned by McpArguments; other values, objects and
+	// arrays included, are also available as their JSON text through
+	// AsString().
+	class McpValue {
+	public:
+		enum Type {
+			VALUE_NONE = 0,
+			VALUE_NULL,
+			VALUE_BOOL,
+			VALUE_INTEGER,
+			VALUE_NUMBER,
+			VALUE_STRING,
+			VALUE_OBJECT,
+			VALUE_ARRAY
+		};
+
+		static McpValue Bool(bool value) { McpValue v; v.m_type = VALUE_BOOL; v.m_bool = value; return v; }
+		static McpValue Integer(int64_t value) { McpValue v; v.m_type = VALUE_INTEGER; v.m_integer = value; return v; }
+		static McpValue Number(double value) { McpValue v; v.m_type = VALUE_NUMBER; v.m_number = value; return v; }
+
+		Type GetType() const { return m_type; }
+		bool IsNone() const { return m_type == VALUE_NONE; }
+		bool AsBool(bool def = false) const { return m_type == VALUE_BOOL ? m_bool : def; }
+		int64_t AsInteger(int64_t def = 0) const;
+		double AsNumber(double def = 0) const;
+		std::string_view AsString() const { return m_string; }
+
+		// Members of an object or elements of an array
+		size_t Size() const { return m_size; }
+		const McpValue& operator[](size_t index) const { return m_children[index]; }
+		std::string_view Key(size_t index) const { return m_children[index].m_key; }
+		const McpValue* Find(std::string_view key) const;
+
+	private:
+		friend class McpServer;
+		Type m_type = VALUE_NONE;
+		union {
+			bool m_bool;
+			int64_t m_integer;
+			double m_number = 0;
+		};
+		std::string_view m_string;
+		std::string_view m_key;
+		const McpValue* m_children = nullptr;
+		size_t m_first = 0;
+		size_t m_size = 0;
+	};
+
 	struct McpPropertyValue {
 		std::string property_name;
 		std::string value;
+		McpValue typed_value;
 	};
+	// With a mime_type, value holds binary data sent base64-encoded as an
+	// "audio" item for audio/* types and as an "image" item otherwise
 	struct McpContent {
 		PropertyType property_type;
 		std::string value;
 		std::vector<McpPropertyValue> properties;
+		std::string mime_type;
+	};
+
+	// Reports notifications/progress for the call's _meta.progressToken on
+	// the response stream, from any thread. Reports closer together than the
+	// progress interval are coalesced into the latest one. Does nothing when
+	// the client asked for no progress, for tools answered inline and for
+	// streaming tools.
+	class McpProgress {
+	public:
+		void Report(double progress, double total = 0, const char* message = nullptr) const;
+		bool IsActive() const { return m_state != nullptr; }
+
+	private:
+		friend class McpServer;
+		struct State;
+		std::shared_ptr<State> m_state;
+	};
+
+	// Tool arguments in input_schema declaration order, addressable by
+	// position or by name. Missing arguments are VALUE_NONE.
+	class McpArguments {
+	public:
+		McpArguments() = default;
+		McpArguments(McpArguments&&) = default;
+		McpArguments& operator=(McpArguments&&) = default;
+		McpArguments(const McpArguments&) = delete;
+		McpArguments& operator=(const McpArguments&) = delete;
+
+		size_t Size() const { return m_count; }
+		bool Has(size_t index) const { return index < m_count && !m_values[index].IsNone(); }
+		bool Has(std::string_view name) const { int index = IndexOf(name); return index >= 0 && Has((size_t)index); }
+		int IndexOf(std::string_view name) const { return m_index != nullptr ? m_index->Find(name) : -1; }
+		const std::string& Name(size_t index) const { return m_index->names[index]; }
+		const McpValue& operator[](size_t index) const { return m_values[index]; }
+		const McpValue& operator[](std::string_view name) const;
+		const McpProgress& Progress() const { return m_progress; }
+		// Stop is requested when the client sends notifications/cancelled
+		// for the call. Hooks run on cancellation, or right away if it has
+		// already happened; calls answered inline are never cancelled.
+		std::stop_token StopToken() const;
+		void OnCancel(std::function<void()> hook) const;
+
+	private:
+		friend class McpServer;
+		const McpNameIndex* m_index = nullptr;
+		size_t m_count = 0;
+		// The top-level arguments come first, nested values follow
+		std::vector<McpValue> m_values;
+		std::vector<char> m_storage;
+		McpProgress m_progress;
+		std::shared_ptr<McpCancellation> m_cancellation;
+	};
+
+	// Handed to asynchronous tools. The reply is sent when Complete() or
+	// Fail() is first called, from any thread; the arguments stay valid until
+	// then. Dropping every copy without completing answers with an error.
+	class McpCompletion {
+	public:
+		void Complete(std::vector<McpContent> contents) const;
+		void Fail(const char* message) const;
+
+	private:
+		friend class McpServer;
+		struct State;
+		std::shared_ptr<State> m_state;
 	};
 
 	void SetAuthorization(
@@ -53,6 +207,19 @@ public:
 		const char* scopes_supported
 	);
 
+	// Verifies the signature, "exp", "nbf", "aud" and, unless issuer is
+	// nullptr, "iss" of bearer tokens against a JWKS document. source is a
+	// file path or an http(s) URL; it is reloaded every refresh_interval
+	// milliseconds in the background, or only once if it is 0. An https
+	// source is only fetched with ca_file, a PEM file of the certificates
+	// its server certificate is checked against. RSA and EC keys verify
+	// RS*, PS* and ES* tokens; "oct" keys with "alg": "HS256" verify HS256
+	// tokens. Without a JWKS only "aud" is checked.
+	void SetJwks(const char* source, const char* issuer, uint64_t refresh_interval = 60 * 60 * 1000, const char* ca_file = nullptr);
+	// Verified bearer tokens remembered until their "exp"; 0 disables it
+	void SetTokenCacheSize(size_t entries);
+	McpTokenCache::Stats GetTokenCacheStats() const;
+
 	void AddTool(
 		const char* tool_name, 
 		const char* tool_description, 
@@ -61,7 +228,209 @@ public:
 		std::function <std::vector<McpContent>(const std::map<std::string, std::string>& args)> callback
 		);
 
-	bool Run(const char* url, uint64_t session_timeout);
+	void AddTool(
+		const char* tool_name, 
+		const char* tool_description, 
+		const std::vector<McpProperty>& input_schema,
+		const std::vector<McpProperty>& output_schema,
+		std::function <std::vector<McpContent>(const McpArguments& args)> callback
+		);
+
+	// The callback runs on the event loop and must not block; it starts the
+	// work and completes the handle later
+	void AddAsyncTool(
+		const char* tool_name, 
+		const char* tool_description, 
+		const std::vector<McpProperty>& input_schema,
+		const std::vector<McpProperty>& output_schema,
+		std::function <void(const McpArguments& args, McpCompletion completion)> callback
+		);
+
+	// The handler coroutine starts on the event loop and resumes there after
+	// every co_await; the arguments stay valid until it returns
+	void AddCoroutineTool(
+		const char* tool_name, 
+		const char* tool_description, 
+		const std::vector<McpProperty>& input_schema,
+		const std::vector<McpProperty>& output_schema,
+		std::function <McpTask<std::vector<McpContent>>(const McpArguments& args)> handler
+		);
+
+	// Result of a streaming tool, written to the connection as chunks of one
+	// SSE response while the handler produces it
+	class McpResultStream {
+	public:
+		class McpWrite {
+		public:
+			McpWrite(McpResultStream* stream, bool wait) : m_stream(stream), m_wait(wait) {}
+			bool await_ready() const noexcept { return !m_wait; }
+			void await_suspend(std::coroutine_handle<> handle) { m_stream->m_waiting = handle; }
+			bool await_resume() const noexcept { return m_stream->m_connection != nullptr && !m_stream->m_stop_token.stop_requested(); }
+
+		private:
+			McpResultStream* m_stream;
+			bool m_wait;
+		};
+
+		// Sends one content item, or one structured row for a tool with an
+		// output schema. Awaiting it suspends while more than the streaming
+		// window is queued on the connection; it yields false once the
+		// client has gone or the call was cancelled.
+		McpWrite Write(const McpContent& content);
+
+	private:
+		friend class McpServer;
+		McpServer* m_server;
+		const McpTool* m_tool;
+		void* m_connection;
+		std::stop_token m_stop_token;
+		size_t m_items;
+		std::coroutine_handle<> m_waiting;
+	};
+
+	// Streaming tools run on the event loop like coroutine tools; the reply
+	// headers go out before the handler starts
+	void AddStreamingTool(
+		const char* tool_name, 
+		const char* tool_description, 
+		const std::vector<McpProperty>& input_schema,
+		const std::vector<McpProperty>& output_schema,
+		std::function <McpTask<void>(const McpArguments& args, McpResultStream& stream)> handler
+		);
+
+	// Awaitables for coroutine tools. They are awaited on an event loop
+	// thread and resume the coroutine on that same loop.
+	class McpSleep {
+	public:
+		explicit McpSleep(uint64_t milliseconds) : m_milliseconds(milliseconds) {}
+		bool await_ready() const noexcept { return false; }
+		// false, resuming at once, if no timer could be added
+		bool await_suspend(std::coroutine_handle<> handle);
+		void await_resume() const noexcept {}
+
+	private:
+		uint64_t m_milliseconds;
+	};
+	static McpSleep Sleep(uint64_t milliseconds)
+	{
+		return McpSleep(milliseconds);
+	}
+
+	// Adapts a callback-style operation: start receives a function to call
+	// exactly once with the result, from any thread
+	template <class T>
+	class McpCallback {
+	public:
+		explicit McpCallback(std::function<void(std::function<void(T)>)> start) : m_start(std::move(start)) {}
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			void* loop = CurrentLoop();
+			m_start([this, handle, loop](T value) {
+				m_value.emplace(std::move(value));
+				ResumeOnLoop(loop, handle);
+			});
+		}
+		T await_resume() { return std::move(*m_value); }
+
+	private:
+		std::function<void(std::function<void(T)>)> m_start;
+		std::optional<T> m_value;
+	};
+	template <class T>
+	static McpCallback<T> Await(std::function<void(std::function<void(T)>)> start)
+	{
+		return McpCallback<T>(std::move(start));
+	}
+
+	// Runs blocking work on the worker pool, or in place when there is none
+	template <class T>
+	McpCallback<std::pair<std::optional<T>, std::exception_ptr>> RunOnWorker(std::function<T()> work)
+	{
+		return McpCallback<std::pair<std::optional<T>, std::exception_ptr>>(
+			[this, work = std::move(work)](std::function<void(std::pair<std::optional<T>, std::exception_ptr>)> done) {
+				auto job = [work, done]() {
+					try
+					{
+						done({ work(), nullptr });
+					}
+					catch (...)
+					{
+						done({ std::nullopt, std::current_exception() });
+					}
+				};
+				if (m_workers.empty())
+				{
+					job();
+				}
+				else
+				{
+					PostJob(job);
+				}
+			}
+		);
+	}
+
+	// HTTP request through a mongoose client connection on the current loop.
+	// An https server certificate is checked against the PEM certificates in
+	// ca when it is not empty. status is 0 if the connection failed or no
+	// response arrived within timeout milliseconds.
+	struct McpHttpResponse {
+		int status;
+		std::string body;
+	};
+	class McpFetch {
+	public:
+		McpFetch(std::string url, std::string method, std::string headers, std::string body, std::string ca, uint64_t timeout)
+			: m_url(std::move(url)), m_method(std::move(method)), m_headers(std::move(headers)), m_body(std::move(body)), m_ca(std::move(ca)), m_timeout(timeout), m_deadline(0), m_response{ 0, "" }, m_handle(), m_loop(nullptr) {}
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle);
+		McpHttpResponse await_resume() { return std::move(m_response); }
+
+	private:
+		friend class McpServer;
+		std::string m_url;
+		std::string m_method;
+		std::string m_headers;
+		std::string m_body;
+		std::string m_ca;
+		uint64_t m_timeout;
+		uint64_t m_deadline;
+		McpHttpResponse m_response;
+		std::coroutine_handle<> m_handle;
+		void* m_loop;
+	};
+	static McpFetch Fetch(const char* url, const char* method = "GET", const char* headers = "", std::string body = "", std::string ca = "", uint64_t timeout = 30 * 1000)
+	{
+		return McpFetch(url, method, headers, std::move(body), std::move(ca), timeout);
+	}
+
+	void SetToolTextMirror(const char* tool_name, bool enabled);
+	void SetToolsPageSize(size_t page_size);
+	void SetWorkerThreads(size_t worker_threads);
+	void SetGeometricConnectionBuffers(bool geometric);
+	// Bytes a streaming tool may have queued on its connection before
+	// McpResultStream::Write() suspends
+	void SetStreamingWindow(size_t bytes);
+	// Minimum milliseconds between two progress notifications of a call
+	void SetProgressInterval(uint64_t milliseconds);
+	// Bytes of serialized events kept per session for Last-Event-ID resume
+	void SetSessionEventBuffer(size_t bytes);
+
+	// Queues a JSON-RPC notification on the session's GET stream. params is
+	// a JSON object or nullptr. Returns false if the session is unknown or
+	// the event does not fit in the session's event buffer.
+	bool SendNotification(const char* session_id, const char* method, const char* params);
+
+	struct BufferStats {
+		uint64_t requests;
+		uint64_t allocations;
+		uint64_t bytes_copied;
+		uint64_t response_bytes;
+	};
+	BufferStats GetBufferStats() const;
+
+	bool Run(const char* url, uint64_t session_timeout, size_t event_loops = 1);
 
 private:
 	std::string m_server_name;
@@ -74,30 +443,246 @@ private:
 
 	bool UpdateUrlPath(const char* url);
 
+	std::string m_tls_cert;
+	std::string m_tls_key;
+	void* m_tls_shared;
+
+	bool LoadTlsContext(const char* cert_file, const char* key_file);
+	void FreeTlsContext();
+
 	struct McpTool {
 		std::string name;
 		std::string description;
 		std::map<std::string, McpProperty> input_schema;
 		std::map<std::string, McpProperty> output_schema;
-		std::function <std::vector<McpContent>(const std::map<std::string, std::string>& args)> callback;
+		McpNameIndex arguments;
+		std::vector<bool> required;
+		std::vector<PropertyType> types;
+		// Output encoder: property names resolved to pre-escaped
+		// "name": fragments and their schema types
+		McpNameIndex outputs;
+		std::vector<std::string> output_keys;
+		std::vector<PropertyType> output_types;
+		bool text_mirror;
+		std::function <std::vector<McpContent>(const McpArguments& args)> callback;
+		std::function <void(const McpArguments& args, McpCompletion completion)> async_callback;
+		std::function <McpTask<void>(const McpArguments& args, McpResultStream& stream)> stream_callback;
+		mutable std::atomic<size_t> reply_size_hint;
 	};
-	std::map<std::string, McpTool> m_tools;
+	std::map<std::string, McpTool, std::less<>> m_tools;
+
+	McpTool& DefineTool(
+		const char* tool_name, 
+		const char* tool_description, 
+		const std::vector<McpProperty>& input_schema,
+		const std::vector<McpProperty>& output_schema
+		);
 
 	static std::string GetPropertyType(PropertyType type);
-	static std::string GetPropertyValue(const McpTool& tool, McpPropertyValue type, bool escape);
+	static void WritePropertyValue(McpJsonWriter& writer, PropertyType type, const McpPropertyValue& value);
+	static void WriteContentItem(McpJsonWriter& writer, const McpContent& content);
+	static void WriteStructuredRow(McpJsonWriter& writer, const McpTool& tool, const McpContent& content);
+	static void WriteToolResult(void* rpc_req, const McpTool& tool, const std::vector<McpContent>& contents);
+	static void AppendToolJson(std::string& tools_json, const McpTool& tool);
+	static bool ExtractArguments(void* rpc_req, const McpTool& tool, const char* json, size_t len, McpArguments& arguments);
+	static bool DecodeValue(McpArguments& arguments, size_t index, const char* json, size_t len);
+	static bool CheckArgumentType(McpValue& value, PropertyType type);
 
-	std::map<std::string, long> m_sessions;
+	// Pre-serialized results that only change with the tool registry
+	struct McpResultCache {
+		std::string initialize_result;
+		std::vector<std::string> tools_pages;
+	};
+	size_t m_tools_page_size;
+	std::mutex m_result_cache_mutex;
+	std::shared_ptr<const McpResultCache> m_result_cache;
 
-	bool IsEnableSessionId(std::string session_id);
-	void EraseSession(std::string session_id);
+	void BuildResultCache();
+	void InvalidateResultCache();
+	std::shared_ptr<const McpResultCache> GetResultCache();
+
+	// Server-to-client events of a session. Each event is serialized once as
+	// an SSE frame into a fixed-size ring; a GET stream is fed by copying the
+	// frames after its cursor, which is also how Last-Event-ID resumes.
+	struct McpEventStream {
+		struct McpEvent {
+			uint64_t id;
+			size_t offset;
+			size_t len;
+		};
+		std::mutex mutex;
+		std::vector<char> ring;
+		size_t head = 0;
+		size_t used = 0;
+		std::deque<McpEvent> events;
+		uint64_t next_id = 1;
+		// The attached GET connection, if any
+		McpLoop* loop = nullptr;
+		unsigned long connection_id = 0;
+		uint64_t sent_id = 0;
+		bool queued = false;
+		bool closed = false;
+	};
+	struct McpSession {
+		long ttl;
+		// Created on the first GET or notification
+		std::shared_ptr<McpEventStream> events;
+	};
+
+	std::mutex m_session_mutex;
+	std::map<std::string, McpSession, std::less<>> m_sessions;
+	size_t m_session_event_buffer;
+
+	bool IsEnableSessionId(std::string_view session_id);
+	void TouchSession(std::string_view session_id);
+	void EraseSession(std::string_view session_id);
 	void ClearSession();
+	std::shared_ptr<McpEventStream> GetEventStream(std::string_view session_id);
+	bool AppendEvent(const std::shared_ptr<McpEventStream>& events, const char* frame, size_t len);
+	static void CloseEventStream(const std::shared_ptr<McpEventStream>& events);
+	// Signature checks built from a JWKS document, by "kid". A loaded set is
+	// never modified: a refresh builds a new one and swaps the pointer, so
+	// requests keep using the old set until then.
+	struct McpKeySet;
+	std::string m_jwks_source;
+	std::string m_jwks_issuer;
+	uint64_t m_jwks_refresh_interval;
+	std::string m_jwks_ca;
+	std::atomic<bool> m_jwks_refreshing;
+	std::mutex m_key_set_mutex;
+	std::shared_ptr<const McpKeySet> m_key_set;
+	McpTokenCache m_token_cache;
+
+	std::shared_ptr<const McpKeySet> ParseKeySet(const std::string& jwks) const;
+	std::shared_ptr<const McpKeySet> LoadKeySet() const;
+	std::shared_ptr<const McpKeySet> GetKeySet();
+	McpDetachedTask RefreshKeySet();
+	static void cbJwksTimer(void* timer_data);
+	bool VerifyToken(std::string_view token);
+	bool CheckAuthorization(void* connection, std::string_view auth_token);
+	void OpenEventStream(void* connection, std::string_view session_id, std::string_view last_event_id);
+
+	struct McpMethod {
+		void (*handler)(void* rpc_req);
+		bool notification;
+	};
+	McpNameIndex m_method_index;
+	std::vector<McpMethod> m_methods;
+
+	void AddMethod(const char* method, void (*handler)(void* rpc_req), bool notification);
+	const McpMethod* FindMethod(std::string_view method) const;
+
+	// A complete HTTP response built by a worker; FlushReplies() takes over
+	// the buffer and hands it to the connection
+	struct McpReply {
+		unsigned long connection_id;
+		unsigned char* buf;
+		size_t size;
+		size_t len;
+	};
+
+	size_t m_worker_threads;
+	std::vector<std::thread> m_workers;
+	std::mutex m_job_mutex;
+	std::condition_variable m_job_cv;
+	std::deque<std::function<void()>> m_jobs;
+	bool m_workers_stop;
+
+	struct McpLoop {
+		void* mgr;
+		unsigned long wakeup_id;
+		std::mutex reply_mutex;
+		std::deque<McpReply> replies;
+		std::vector<std::coroutine_handle<>> resumes;
+		// GET streams with events to write, or a connection to close
+		struct McpStreamFlush {
+			std::shared_ptr<McpEventStream> stream;
+			unsigned long connection_id;
+		};
+		std::vector<McpStreamFlush> streams;
+		// GET streams attached to connections of this loop, by connection id
+		std::map<unsigned long, std::shared_ptr<McpEventStream>> attached;
+		// Streaming tool results in progress, by connection id
+		std::map<unsigned long, McpResultStream*> results;
+		// Calls with progress to send, and the calls of this loop that
+		// report progress, by connection id
+		std::vector<std::shared_ptr<McpProgress::State>> progress;
+		std::map<unsigned long, std::shared_ptr<McpProgress::State>> progress_calls;
+
+		// Nothing queued, so the next post has to wake the loop up
+		bool Idle() const
+		{
+			return replies.empty() && resumes.empty() && streams.empty() && progress.empty();
+		}
+	};
+	std::vector<std::unique_ptr<McpLoop>> m_loops;
+
+	// Cancellation of a deferred tools/call. Whichever of the reply and the
+	// cancellation comes first takes replied; a cancelled call gets an
+	// empty reply instead of its result.
+	struct McpCancellation {
+		std::stop_source source;
+		std::atomic<bool> replied{ false };
+		McpLoop* loop;
+		unsigned long connection_id;
+		std::string key;
+		std::mutex hook_mutex;
+		std::vector<std::unique_ptr<std::stop_callback<std::function<void()>>>> hooks;
+	};
+	// Calls that can be cancelled, by session id and raw JSON request id
+	std::mutex m_cancel_mutex;
+	std::map<std::string, std::shared_ptr<McpCancellation>, std::less<>> m_cancellations;
+
+	static std::string CancellationKey(std::string_view session_id, std::string_view id);
+	void EndCancellation(const std::shared_ptr<McpCancellation>& cancellation);
+
+	// Where a deferred tools/call reply goes once the result is known
+	struct McpPendingCall {
+		McpServer* server;
+		const McpTool* tool;
+		McpLoop* loop;
+		unsigned long connection_id;
+		std::string session_id;
+		std::string id;
+		std::shared_ptr<McpArguments> arguments;
+		std::shared_ptr<McpCancellation> cancellation;
+	};
+	static void PostToolReply(const McpPendingCall& call, const std::vector<McpContent>* contents, const char* error);
+	static McpDetachedTask StreamToolResult(McpPendingCall call);
+	size_t m_streaming_window;
+	uint64_t m_progress_interval;
+	static void PostProgress(McpLoop* loop, std::shared_ptr<McpProgress::State> state);
+	static void SendProgress(McpLoop* loop, const std::shared_ptr<McpProgress::State>& state);
+	static bool EndProgress(McpLoop* loop, unsigned long connection_id);
+	static void FlushProgress(McpLoop* loop);
+
+	bool m_geometric_connection_buffers;
+	std::atomic<uint64_t> m_stat_requests;
+	std::atomic<uint64_t> m_stat_allocations;
+	std::atomic<uint64_t> m_stat_bytes_copied;
+	std::atomic<uint64_t> m_stat_response_bytes;
 
-	void* m_rpc_head;
+	void StartWorkers();
+	void StopWorkers();
+	void WorkerThread();
+	void PostJob(std::function<void()> job);
+	static void PostReply(McpLoop* loop, McpReply reply);
+	static void FlushReplies(McpLoop* loop);
+	static void PostStreamFlush(McpLoop* loop, std::shared_ptr<McpEventStream> stream, unsigned long connection_id);
+	static void FlushStreams(McpLoop* loop);
+	static void WriteEvents(void* connection, McpEventStream& stream);
+	static void* CurrentLoop();
+	static void ResumeOnLoop(void* loop, std::coroutine_handle<> handle);
+	static void RunResumes(McpLoop* loop);
+	static void cbFetch(void* connection, int event_code, void* event_data);
 
+	static void Dispatch(void* rpc_req);
 	static void cbEvHander(void* connection, int event_code, void* event_data);
 	static void cbTimerHandler(void* timer_data);
 	static void cbInitialize(void* rpc_req);
 	static void cbLoggingSetLevel(void* rpc_req);
 	static void cbToolsList(void* rpc_req);
 	static void cbToolsCall(void* rpc_req);
+	static void cbNotificationsInitialized(void* rpc_req);
+	static void cbNotificationsCancelled(void* rpc_req);
 };
@@ -0,0 +1,276 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "McpSha256.h"
+#include "McpCpu.h"
+
+#include <cstdlib>
+#include <cstring>
+
+const uint32_t McpSha256::INITIAL_STATE[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+alignas(16) static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t Rotr(uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t LoadBigEndian(const unsigned char* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void StoreBigEndian(unsigned char* p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+typedef void (*BlocksFunc)(uint32_t state[8], const unsigned char* data, size_t blocks);
+
+// One round with the roles of the working variables passed in rotated,
+// so eight calls in a row need no shuffling between them
+static inline void Round(uint32_t a, uint32_t b, uint32_t c, uint32_t& d, uint32_t e, uint32_t f, uint32_t g, uint32_t& h, uint32_t kw)
+{
+	uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + kw;
+	uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+	d += t1;
+	h = t1 + t2;
+}
+
+static void BlocksScalar(uint32_t state[8], const unsigned char* data, size_t blocks)
+{
+	for (; blocks > 0; blocks--, data += McpSha256::BLOCK_SIZE)
+	{
+		uint32_t w[64];
+		for (int i = 0; i < 16; i++)
+		{
+			w[i] = LoadBigEndian(data + i * 4);
+		}
+		for (int i = 16; i < 64; i++)
+		{
+			uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+		uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+		for (int i = 0; i < 64; i += 8)
+		{
+			Round(a, b, c, d, e, f, g, h, K[i] + w[i]);
+			Round(h, a, b, c, d, e, f, g, K[i + 1] + w[i + 1]);
+			Round(g, h, a, b, c, d, e, f, K[i + 2] + w[i + 2]);
+			Round(f, g, h, a, b, c, d, e, K[i + 3] + w[i + 3]);
+			Round(e, f, g, h, a, b, c, d, K[i + 4] + w[i + 4]);
+			Round(d, e, f, g, h, a, b, c, K[i + 5] + w[i + 5]);
+			Round(c, d, e, f, g, h, a, b, K[i + 6] + w[i + 6]);
+			Round(b, c, d, e, f, g, h, a, K[i + 7] + w[i + 7]);
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+#if defined(MCP_CPU_X86)
+// sha256rnds2 works on the state as ABEF/CDGH halves and does two rounds
+// per call; sha256msg1/msg2 extend the schedule four words at a time.
+MCP_TARGET_SHA static inline void ShaRounds(__m128i& abef, __m128i& cdgh, __m128i w, int i)
+{
+	__m128i wk = _mm_add_epi32(w, _mm_load_si128((const __m128i*)&K[i * 4]));
+	cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+	abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e));
+}
+
+// The four words 16 on from w0, given the twelve after it
+MCP_TARGET_SHA static inline __m128i ShaSchedule(__m128i w0, __m128i w1, __m128i w2, __m128i w3)
+{
+	__m128i next = _mm_sha256msg1_epu32(w0, w1);
+	next = _mm_add_epi32(next, _mm_alignr_epi8(w3, w2, 4));
+	return _mm_sha256msg2_epu32(next, w3);
+}
+
+MCP_TARGET_SHA static void BlocksShaNi(uint32_t state[8], const unsigned char* data, size_t blocks)
+{
+	const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i dcba = _mm_loadu_si128((const __m128i*)&state[0]);
+	__m128i hgfe = _mm_loadu_si128((const __m128i*)&state[4]);
+	__m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+	__m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+	__m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+	__m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+	for (; blocks > 0; blocks--, data += McpSha256::BLOCK_SIZE)
+	{
+		__m128i abef_saved = abef;
+		__m128i cdgh_saved = cdgh;
+		__m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), byte_swap);
+		__m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), byte_swap);
+		__m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), byte_swap);
+		__m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), byte_swap);
+		// Each group of sixteen rounds replaces the words it has consumed
+		for (int i = 0; i < 12; i += 4)
+		{
+			ShaRounds(abef, cdgh, w0, i);
+			w0 = ShaSchedule(w0, w1, w2, w3);
+			ShaRounds(abef, cdgh, w1, i + 1);
+			w1 = ShaSchedule(w1, w2, w3, w0);
+			ShaRounds(abef, cdgh, w2, i + 2);
+			w2 = ShaSchedule(w2, w3, w0, w1);
+			ShaRounds(abef, cdgh, w3, i + 3);
+			w3 = ShaSchedule(w3, w0, w1, w2);
+		}
+		ShaRounds(abef, cdgh, w0, 12);
+		ShaRounds(abef, cdgh, w1, 13);
+		ShaRounds(abef, cdgh, w2, 14);
+		ShaRounds(abef, cdgh, w3, 15);
+		abef = _mm_add_epi32(abef, abef_saved);
+		cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+	}
+
+	__m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+	__m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+	_mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(feba, dchg, 0xf0));
+	_mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+#endif
+
+static BlocksFunc SelectBlocks()
+{
+#if defined(MCP_CPU_X86)
+	if (McpCpu().sha && getenv("MCP_SHA256_SCALAR") == nullptr)
+	{
+		return BlocksShaNi;
+	}
+#endif
+	return BlocksScalar;
+}
+static const BlocksFunc s_blocks = SelectBlocks();
+
+void McpSha256::Blocks(uint32_t state[8], const unsigned char* data, size_t blocks)
+{
+	s_blocks(state, data, blocks);
+}
+
+void McpSha256::Finish(uint32_t state[8], uint64_t prefix_len, const void* data, size_t len, unsigned char digest[DIGEST_SIZE])
+{
+	const unsigned char* in = (const unsigned char*)data;
+	size_t blocks = len / BLOCK_SIZE;
+	if (blocks > 0)
+	{
+		s_blocks(state, in, blocks);
+	}
+
+	// The rest, 0x80, zeros and the bit length fill one block or two
+	unsigned char tail[BLOCK_SIZE * 2] = {};
+	size_t rest = len % BLOCK_SIZE;
+	if (rest > 0)
+	{
+		memcpy(tail, in + blocks * BLOCK_SIZE, rest);
+	}
+	tail[rest] = 0x80;
+	size_t tail_blocks = rest < BLOCK_SIZE - 8 ? 1 : 2;
+	uint64_t bits = (prefix_len + len) * 8;
+	unsigned char* length = tail + tail_blocks * BLOCK_SIZE - 8;
+	StoreBigEndian(length, (uint32_t)(bits >> 32));
+	StoreBigEndian(length + 4, (uint32_t)bits);
+	s_blocks(state, tail, tail_blocks);
+
+	for (int i = 0; i < 8; i++)
+	{
+		StoreBigEndian(digest + i * 4, state[i]);
+	}
+}
+
+void McpSha256::Hash(const void* data, size_t len, unsigned char digest[DIGEST_SIZE])
+{
+	uint32_t state[8];
+	memcpy(state, INITIAL_STATE, sizeof(state));
+	Finish(state, 0, data, len, digest);
+}
+
+McpHmacSha256::McpHmacSha256(std::string_view key)
+{
+	unsigned char block[McpSha256::BLOCK_SIZE] = {};
+	if (key.size() > McpSha256::BLOCK_SIZE)
+	{
+		McpSha256::Hash(key.data(), key.size(), block);
+	}
+	else if (!key.empty())
+	{
+		memcpy(block, key.data(), key.size());
+	}
+
+	unsigned char pad[McpSha256::BLOCK_SIZE];
+	for (size_t i = 0; i < sizeof(pad); i++)
+	{
+		pad[i] = block[i] ^ 0x36;
+	}
+	memcpy(m_inner, McpSha256::INITIAL_STATE, sizeof(m_inner));
+	McpSha256::Blocks(m_inner, pad, 1);
+	for (size_t i = 0; i < sizeof(pad); i++)
+	{
+		pad[i] = block[i] ^ 0x5c;
+	}
+	memcpy(m_outer, McpSha256::INITIAL_STATE, sizeof(m_outer));
+	McpSha256::Blocks(m_outer, pad, 1);
+}
+
+void McpHmacSha256::Sign(std::string_view data, unsigned char mac[McpSha256::DIGEST_SIZE]) const
+{
+	uint32_t state[8];
+	unsigned char inner[McpSha256::DIGEST_SIZE];
+	memcpy(state, m_inner, sizeof(state));
+	McpSha256::Finish(state, McpSha256::BLOCK_SIZE, data.data(), data.size(), inner);
+	memcpy(state, m_outer, sizeof(state));
+	McpSha256::Finish(state, McpSha256::BLOCK_SIZE, inner, sizeof(inner), mac);
+}
+
+bool McpHmacSha256::Verify(std::string_view data, std::string_view mac) const
+{
+	if (mac.size() != McpSha256::DIGEST_SIZE)
+	{
+		return false;
+	}
+	unsigned char expected[McpSha256::DIGEST_SIZE];
+	Sign(data, expected);
+	unsigned char diff = 0;
+	for (size_t i = 0; i < sizeof(expected); i++)
+	{
+		diff |= expected[i] ^ (unsigned char)mac[i];
+	}
+	return diff == 0;
+}
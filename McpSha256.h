@@ -0,0 +1,59 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// SHA-256 (FIPS 180-4). The compression function uses the SHA extensions
+// when the CPU has them.
+class McpSha256
+{
+public:
+	static const size_t BLOCK_SIZE = 64;
+	static const size_t DIGEST_SIZE = 32;
+
+	// Runs the compression function over whole 64-byte blocks. Has the
+	// signature mongoose takes for mg_sha256_set_blocks().
+	static void Blocks(uint32_t state[8], const unsigned char* data, size_t blocks);
+
+	static void Hash(const void* data, size_t len, unsigned char digest[DIGEST_SIZE]);
+
+	// Hashes data that follows prefix_len bytes already compressed into
+	// state, which must be a multiple of BLOCK_SIZE
+	static void Finish(uint32_t state[8], uint64_t prefix_len, const void* data, size_t len, unsigned char digest[DIGEST_SIZE]);
+
+	static const uint32_t INITIAL_STATE[8];
+};
+
+// HMAC-SHA256 (RFC 2104) with the key-padding blocks compressed once up
+// front: a MAC then costs the message blocks plus two.
+class McpHmacSha256
+{
+public:
+	explicit McpHmacSha256(std::string_view key);
+
+	void Sign(std::string_view data, unsigned char mac[McpSha256::DIGEST_SIZE]) const;
+	// Constant time in the contents of mac
+	bool Verify(std::string_view data, std::string_view mac) const;
+
+private:
+	uint32_t m_inner[8];
+	uint32_t m_outer[8];
+};
@@ -0,0 +1,271 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Coroutine frames are recycled through per-thread free lists in 64-byte
+// size classes instead of going back to the heap after every tool call.
+// Frames larger than the biggest class use the heap directly.
+class McpFrameAllocator
+{
+public:
+	struct Stats {
+		uint64_t allocations;
+		uint64_t reused;
+	};
+
+	static void* Allocate(size_t size)
+	{
+		Pool& pool = GetPool();
+		pool.stats.allocations++;
+		size_t index = (size + CLASS_SIZE - 1) / CLASS_SIZE;
+		if (index < CLASS_COUNT && pool.free[index] != nullptr)
+		{
+			FreeFrame* frame = pool.free[index];
+			pool.free[index] = frame->next;
+			pool.count[index]--;
+			pool.stats.reused++;
+			return frame;
+		}
+		void* p = malloc(index < CLASS_COUNT ? index * CLASS_SIZE : size);
+		if (p == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		return p;
+	}
+
+	static void Free(void* p, size_t size)
+	{
+		Pool& pool = GetPool();
+		size_t index = (size + CLASS_SIZE - 1) / CLASS_SIZE;
+		if (index < CLASS_COUNT && pool.count[index] < MAX_RETAINED)
+		{
+			FreeFrame* frame = (FreeFrame*)p;
+			frame->next = pool.free[index];
+			pool.free[index] = frame;
+			pool.count[index]++;
+			return;
+		}
+		free(p);
+	}
+
+	// Counters of the calling thread
+	static Stats GetStats()
+	{
+		return GetPool().stats;
+	}
+
+private:
+	static const size_t CLASS_SIZE = 64;
+	static const size_t CLASS_COUNT = 33;
+	static const size_t MAX_RETAINED = 256;
+
+	struct FreeFrame {
+		FreeFrame* next;
+	};
+	struct Pool {
+		FreeFrame* free[CLASS_COUNT] = {};
+		size_t count[CLASS_COUNT] = {};
+		Stats stats = {};
+
+		~Pool()
+		{
+			for (size_t i = 0; i < CLASS_COUNT; i++)
+			{
+				while (free[i] != nullptr)
+				{
+					FreeFrame* next = free[i]->next;
+					::free(free[i]);
+					free[i] = next;
+				}
+			}
+		}
+	};
+
+	static Pool& GetPool()
+	{
+		static thread_local Pool pool;
+		return pool;
+	}
+};
+
+struct McpFramePromise {
+	static void* operator new(size_t size)
+	{
+		return McpFrameAllocator::Allocate(size);
+	}
+	static void operator delete(void* p, size_t size)
+	{
+		McpFrameAllocator::Free(p, size);
+	}
+};
+
+// Result slot of an McpTask promise
+template <class T>
+struct McpTaskResult {
+	std::optional<T> value;
+
+	template <class U>
+	void return_value(U&& result)
+	{
+		value.emplace(std::forward<U>(result));
+	}
+};
+
+template <>
+struct McpTaskResult<void> {
+	void return_void() noexcept
+	{
+	}
+};
+
+// Lazily started coroutine producing a T. Awaiting it starts the body and
+// resumes the awaiting coroutine when it finishes, without a thread switch.
+template <class T>
+class McpTask
+{
+public:
+	struct promise_type : McpFramePromise, McpTaskResult<T> {
+		std::exception_ptr exception;
+		std::coroutine_handle<> continuation;
+
+		McpTask get_return_object()
+		{
+			return McpTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+		auto final_suspend() noexcept
+		{
+			struct FinalAwaiter {
+				bool await_ready() noexcept
+				{
+					return false;
+				}
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+				{
+					std::coroutine_handle<> next = h.promise().continuation;
+					return next ? next : std::noop_coroutine();
+				}
+				void await_resume() noexcept
+				{
+				}
+			};
+			return FinalAwaiter();
+		}
+		void unhandled_exception()
+		{
+			exception = std::current_exception();
+		}
+	};
+
+	McpTask(McpTask&& other) noexcept
+		: m_handle(std::exchange(other.m_handle, nullptr))
+	{
+	}
+	McpTask& operator=(McpTask&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (m_handle)
+			{
+				m_handle.destroy();
+			}
+			m_handle = std::exchange(other.m_handle, nullptr);
+		}
+		return *this;
+	}
+	McpTask(const McpTask&) = delete;
+	McpTask& operator=(const McpTask&) = delete;
+
+	~McpTask()
+	{
+		if (m_handle)
+		{
+			m_handle.destroy();
+		}
+	}
+
+	bool await_ready() const noexcept
+	{
+		return !m_handle || m_handle.done();
+	}
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		m_handle.promise().continuation = awaiting;
+		return m_handle;
+	}
+	T await_resume()
+	{
+		promise_type& promise = m_handle.promise();
+		if (promise.exception)
+		{
+			std::rethrow_exception(promise.exception);
+		}
+		if constexpr (!std::is_void_v<T>)
+		{
+			return std::move(*promise.value);
+		}
+	}
+
+private:
+	explicit McpTask(std::coroutine_handle<promise_type> handle)
+		: m_handle(handle)
+	{
+	}
+
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+// Coroutine that starts immediately and frees itself when it finishes;
+// used to drive a top-level McpTask from a callback
+struct McpDetachedTask {
+	struct promise_type : McpFramePromise {
+		McpDetachedTask get_return_object() noexcept
+		{
+			return {};
+		}
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+		void return_void() noexcept
+		{
+		}
+		void unhandled_exception() noexcept
+		{
+			std::terminate();
+		}
+	};
+};
@@ -0,0 +1,203 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "McpTokenCache.h"
+
+#include <cstring>
+
+McpTokenCache::McpTokenCache(size_t capacity)
+	: m_mutex()
+	, m_entries()
+	, m_index()
+	, m_hand(0)
+	, m_size(0)
+	, m_generation(0)
+	, m_hits(0)
+	, m_misses(0)
+	, m_evictions(0)
+{
+	SetCapacity(capacity);
+}
+
+void McpTokenCache::SetCapacity(size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+	m_entries.resize(capacity);
+	m_index.clear();
+	m_index.reserve(capacity);
+	m_hand = 0;
+	m_size = 0;
+	m_generation++;
+}
+
+// Multiply-xorshift over 8-byte words in four independent lanes, so the
+// multiplies of a 32-byte block overlap; tokens are several hundred bytes
+static inline uint64_t Mix(uint64_t hash, uint64_t word)
+{
+	hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+	return hash ^ (hash >> 29);
+}
+
+uint64_t McpTokenCache::Hash(std::string_view token)
+{
+	const char* p = token.data();
+	size_t len = token.size();
+	uint64_t lane0 = len;
+	uint64_t lane1 = len + 1;
+	uint64_t lane2 = len + 2;
+	uint64_t lane3 = len + 3;
+	for (; len >= 32; p += 32, len -= 32)
+	{
+		uint64_t word[4];
+		memcpy(word, p, 32);
+		lane0 = Mix(lane0, word[0]);
+		lane1 = Mix(lane1, word[1]);
+		lane2 = Mix(lane2, word[2]);
+		lane3 = Mix(lane3, word[3]);
+	}
+	uint64_t hash = Mix(Mix(Mix(lane0, lane1), lane2), lane3);
+	for (; len >= 8; p += 8, len -= 8)
+	{
+		uint64_t word;
+		memcpy(&word, p, 8);
+		hash = Mix(hash, word);
+	}
+	if (len > 0)
+	{
+		uint64_t word = 0;
+		memcpy(&word, p, len);
+		hash = Mix(hash, word);
+	}
+	hash *= 0x9e3779b97f4a7c15ull;
+	return hash ^ (hash >> 32);
+}
+
+bool McpTokenCache::Find(std::string_view token, int64_t now, std::string* scope)
+{
+	uint64_t hash = Hash(token);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_index.find(hash);
+	if (it == m_index.end())
+	{
+		m_misses++;
+		return false;
+	}
+	size_t slot = it->second;
+	Entry& entry = m_entries[slot];
+	if (entry.token != token)
+	{
+		m_misses++;
+		return false;
+	}
+	if (now >= entry.expires_at)
+	{
+		Remove(slot);
+		m_misses++;
+		return false;
+	}
+	entry.referenced = true;
+	m_hits++;
+	if (scope != nullptr)
+	{
+		*scope = entry.scope;
+	}
+	return true;
+}
+
+void McpTokenCache::Insert(std::string_view token, int64_t expires_at, std::string_view scope, uint64_t generation)
+{
+	uint64_t hash = Hash(token);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_entries.empty() || generation != m_generation)
+	{
+		return;
+	}
+
+	size_t slot;
+	auto it = m_index.find(hash);
+	if (it != m_index.end())
+	{
+		// Same token verified twice concurrently, or a hash collision
+		slot = it->second;
+	}
+	else
+	{
+		// Referenced entries get a second chance; the hand stops at the
+		// first free slot or unreferenced entry
+		while (true)
+		{
+			Entry& entry = m_entries[m_hand];
+			if (!entry.used)
+			{
+				break;
+			}
+			if (!entry.referenced)
+			{
+				Remove(m_hand);
+				m_evictions++;
+				break;
+			}
+			entry.referenced = false;
+			m_hand = (m_hand + 1) % m_entries.size();
+		}
+		slot = m_hand;
+		m_hand = (m_hand + 1) % m_entries.size();
+		m_index.emplace(hash, slot);
+		m_size++;
+	}
+
+	Entry& entry = m_entries[slot];
+	entry.hash = hash;
+	entry.expires_at = expires_at;
+	entry.used = true;
+	entry.referenced = false;
+	entry.token.assign(token.data(), token.size());
+	entry.scope.assign(scope.data(), scope.size());
+}
+
+void McpTokenCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (Entry& entry : m_entries)
+	{
+		entry.used = false;
+	}
+	m_index.clear();
+	m_size = 0;
+	m_generation++;
+}
+
+uint64_t McpTokenCache::Generation() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_generation;
+}
+
+McpTokenCache::Stats McpTokenCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return { m_hits, m_misses, m_evictions, m_size };
+}
+
+void McpTokenCache::Remove(size_t slot)
+{
+	Entry& entry = m_entries[slot];
+	m_index.erase(entry.hash);
+	entry.used = false;
+	m_size--;
+}
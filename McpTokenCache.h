@@ -0,0 +1,88 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Bearer tokens that passed verification, so a client repeating the same
+// token skips decoding and the signature check. Entries are looked up by a
+// hash of the raw token, compared in full, and dropped at the token's "exp".
+// When the cache is full the CLOCK hand evicts an entry not used since its
+// last sweep.
+class McpTokenCache
+{
+public:
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		size_t entries;
+	};
+
+	explicit McpTokenCache(size_t capacity = 1024);
+
+	McpTokenCache(const McpTokenCache&) = delete;
+	McpTokenCache& operator=(const McpTokenCache&) = delete;
+
+	// Drops every entry; 0 disables the cache
+	void SetCapacity(size_t capacity);
+
+	// now and expires_at are seconds since the epoch. scope, if given,
+	// receives the token's "scope" claim on a hit.
+	bool Find(std::string_view token, int64_t now, std::string* scope = nullptr);
+
+	// generation is the value of Generation() read before the token was
+	// verified; the entry is not stored if Clear() has run since
+	void Insert(std::string_view token, int64_t expires_at, std::string_view scope, uint64_t generation);
+
+	// Drops every entry, e.g. after the verification keys changed
+	void Clear();
+	uint64_t Generation() const;
+
+	Stats GetStats() const;
+
+	static uint64_t Hash(std::string_view token);
+
+private:
+	struct Entry {
+		uint64_t hash;
+		int64_t expires_at;
+		bool used;
+		bool referenced;
+		std::string token;
+		std::string scope;
+	};
+
+	void Remove(size_t slot);
+
+	mutable std::mutex m_mutex;
+	std::vector<Entry> m_entries;
+	std::unordered_map<uint64_t, size_t> m_index;
+	size_t m_hand;
+	size_t m_size;
+	uint64_t m_generation;
+	uint64_t m_hits;
+	uint64_t m_misses;
+	uint64_t m_evictions;
+};
@@ -716,9 +716,31 @@ static size_t mg_lld(char *buf, int64_t val, bool is_signed, bool is_hex) {
   return n + s;
 }
 
+// Bulk append for the iobuf sink: one resize and one memcpy per run instead
+// of a callback per character. Keeps the iobuf 0-terminated like mg_pfn_iobuf
+static size_t mg_iobuf_putn(struct mg_iobuf *io, const char *buf, size_t len) {
+  if (io->len + len + 1 > io->size) {
+    mg_iobuf_resize(io, mg_iobuf_grow_size(io, io->len + len + 1));
+  }
+  if (io->len + len + 1 > io->size) {
+    size_t i = 0;  // Resize failed, fall back to the truncating char path
+    while (i < len) mg_pfn_iobuf(buf[i++], io);
+    return len;
+  }
+  memcpy(io->buf + io->len, buf, len);
+  io->len += len;
+  io->buf[io->len] = 0;
+  return len;
+}
+
 static size_t scpy(void (*out)(char, void *), void *ptr, char *buf,
                           size_t len) {
   size_t i = 0;
+  if (out == mg_pfn_iobuf && len > 0) {
+    const char *z = (const char *) memchr(buf, '\0', len);
+    if (z != NULL) len = (size_t) (z - buf);
+    return mg_iobuf_putn((struct mg_iobuf *) ptr, buf, len);
+  }
   while (i < len && buf[i] != '\0') out(buf[i++], ptr);
   return i;
 }
@@ -814,7 +836,8 @@ size_t mg_vxprintf(void (*out)(char, void *), void *param, const char *fmt,
       }
       i++;
     } else {
-      out(fmt[i], param), n++, i++;
+      size_t run = strcspn(&fmt[i], "%");  // Literal text up to next directive
+      n += scpy(out, param, (char *) &fmt[i], run), i += run;
     }
   }
   return n;
@@ -2590,6 +2613,27 @@ static size_t roundup(size_t size, size_t align) {
   return align == 0 ? size : (size + align - 1) / align * align;
 }
 
+#if defined(_MSC_VER)
+static __declspec(thread) struct mg_iobuf_stats s_iobuf_stats;
+#elif defined(__GNUC__) || defined(__clang__)
+static __thread struct mg_iobuf_stats s_iobuf_stats;
+#else
+static struct mg_iobuf_stats s_iobuf_stats;
+#endif
+
+struct mg_iobuf_stats *mg_iobuf_stats(void) {
+  return &s_iobuf_stats;
+}
+
+// Capacity to request when appending needs `need` bytes in total
+size_t mg_iobuf_grow_size(struct mg_iobuf *io, size_t need) {
+  if (io->geometric && need <= io->size) need = io->size;
+  if (io->geometric && need > io->size && need < io->size * 2) {
+    need = io->size * 2;
+  }
+  return roundup(need, io->align);
+}
+
 int mg_iobuf_resize(struct mg_iobuf *io, size_t new_size) {
   int ok = 1;
   new_size = roundup(new_size, io->align);
@@ -2604,6 +2648,8 @@ int mg_iobuf_resize(struct mg_iobuf *io, size_t new_size) {
     if (p != NULL) {
       size_t len = new_size < io->len ? new_size : io->len;
       if (len > 0 && io->buf != NULL) memmove(p, io->buf, len);
+      s_iobuf_stats.allocs++;
+      s_iobuf_stats.copied += io->buf != NULL ? len : 0;
       mg_bzero(io->buf, io->size);
       mg_free(io->buf);
       io->buf = (unsigned char *) p;
@@ -2625,7 +2671,7 @@ int mg_iobuf_init(struct mg_iobuf *io, size_t size, size_t align) {
 
 size_t mg_iobuf_add(struct mg_iobuf *io, size_t ofs, const void *buf,
                     size_t len) {
-  size_t new_size = roundup(io->len + len, io->align);
+  size_t new_size = mg_iobuf_grow_size(io, io->len + len);
   mg_iobuf_resize(io, new_size);      // Attempt to resize
   if (new_size != io->size) len = 0;  // Resize failure, append nothing
   if (ofs < io->len) memmove(io->buf + ofs + len, io->buf + ofs, io->len - ofs);
@@ -7722,7 +7768,9 @@ size_t mg_queue_printf(struct mg_queue *q, const char *fmt, ...) {
 
 static void mg_pfn_iobuf_private(char ch, void *param, bool expand) {
   struct mg_iobuf *io = (struct mg_iobuf *) param;
-  if (expand && io->len + 2 > io->size) mg_iobuf_resize(io, io->len + 2);
+  if (expand && io->len + 2 > io->size) {
+    mg_iobuf_resize(io, mg_iobuf_grow_size(io, io->len + 2));
+  }
   if (io->len + 2 <= io->size) {
     io->buf[io->len++] = (uint8_t) ch;
     io->buf[io->len] = 0;
@@ -7740,7 +7788,7 @@ void mg_pfn_iobuf(char ch, void *param) {
 }
 
 size_t mg_vsnprintf(char *buf, size_t len, const char *fmt, va_list *ap) {
-  struct mg_iobuf io = {(uint8_t *) buf, len, 0, 0};
+  struct mg_iobuf io = {(uint8_t *) buf, len, 0, 0, false};
   size_t n = mg_vxprintf(mg_putchar_iobuf_static, &io, fmt, ap);
   if (n < len) buf[n] = '\0';
   return n;
@@ -7756,7 +7804,7 @@ size_t mg_snprintf(char *buf, size_t len, const char *fmt, ...) {
 }
 
 char *mg_vmprintf(const char *fmt, va_list *ap) {
-  struct mg_iobuf io = {0, 0, 0, 256};
+  struct mg_iobuf io = {0, 0, 0, 256, false};
   mg_vxprintf(mg_pfn_iobuf, &io, fmt, ap);
   return (char *) io.buf;
 }
@@ -8333,54 +8381,74 @@ void mg_sha256_init(mg_sha256_ctx *ctx) {
   ctx->state[7] = 0x5be0cd19;
 }
 
-static void mg_sha256_chunk(mg_sha256_ctx *ctx) {
-  int i, j;
-  uint32_t a, b, c, d, e, f, g, h;
-  uint32_t m[64];
-  for (i = 0, j = 0; i < 16; ++i, j += 4)
-    m[i] = (uint32_t) (((uint32_t) ctx->buffer[j] << 24) |
-                       ((uint32_t) ctx->buffer[j + 1] << 16) |
-                       ((uint32_t) ctx->buffer[j + 2] << 8) |
-                       ((uint32_t) ctx->buffer[j + 3]));
-  for (; i < 64; ++i)
-    m[i] = sig1(m[i - 2]) + m[i - 7] + sig0(m[i - 15]) + m[i - 16];
-
-  a = ctx->state[0];
-  b = ctx->state[1];
-  c = ctx->state[2];
-  d = ctx->state[3];
-  e = ctx->state[4];
-  f = ctx->state[5];
-  g = ctx->state[6];
-  h = ctx->state[7];
-
-  for (i = 0; i < 64; ++i) {
-    uint32_t t1 = h + ep1(e) + ch(e, f, g) + mg_sha256_k[i] + m[i];
-    uint32_t t2 = ep0(a) + maj(a, b, c);
-    h = g;
-    g = f;
-    f = e;
-    e = d + t1;
-    d = c;
-    c = b;
-    b = a;
-    a = t1 + t2;
-  }
+static void mg_sha256_blocks_c(uint32_t state[8], const unsigned char *data,
+                               size_t blocks) {
+  for (; blocks > 0; blocks--, data += 64) {
+    int i, j;
+    uint32_t a, b, c, d, e, f, g, h;
+    uint32_t m[64];
+    for (i = 0, j = 0; i < 16; ++i, j += 4)
+      m[i] = (uint32_t) (((uint32_t) data[j] << 24) |
+                         ((uint32_t) data[j + 1] << 16) |
+                         ((uint32_t) data[j + 2] << 8) |
+                         ((uint32_t) data[j + 3]));
+    for (; i < 64; ++i)
+      m[i] = sig1(m[i - 2]) + m[i - 7] + sig0(m[i - 15]) + m[i - 16];
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+
+    for (i = 0; i < 64; ++i) {
+      uint32_t t1 = h + ep1(e) + ch(e, f, g) + mg_sha256_k[i] + m[i];
+      uint32_t t2 = ep0(a) + maj(a, b, c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+static mg_sha256_blocks_fn s_mg_sha256_blocks = mg_sha256_blocks_c;
+
+void mg_sha256_set_blocks(mg_sha256_blocks_fn fn) {
+  s_mg_sha256_blocks = fn != NULL ? fn : mg_sha256_blocks_c;
+}
 
-  ctx->state[0] += a;
-  ctx->state[1] += b;
-  ctx->state[2] += c;
-  ctx->state[3] += d;
-  ctx->state[4] += e;
-  ctx->state[5] += f;
-  ctx->state[6] += g;
-  ctx->state[7] += h;
+static void mg_sha256_chunk(mg_sha256_ctx *ctx) {
+  s_mg_sha256_blocks(ctx->state, ctx->buffer, 1);
 }
 
 void mg_sha256_update(mg_sha256_ctx *ctx, const unsigned char *data,
                       size_t len) {
   size_t i;
   for (i = 0; i < len; i++) {
+    if (ctx->len == 0 && len - i >= 64) {
+      size_t n = (len - i) / 64;  // Whole blocks straight from the input
+      s_mg_sha256_blocks(ctx->state, data + i, n);
+      ctx->bits += (uint64_t) n * 512;
+      i += n * 64;
+      if (i == len) break;
+    }
     ctx->buffer[ctx->len] = data[i];
     if ((++ctx->len) == 64) {
       mg_sha256_chunk(ctx);
@@ -8959,6 +9027,14 @@ bool mg_open_listener(struct mg_connection *c, const char *url) {
       // won't work! (setsockopt will return EINVAL)
       MG_ERROR(("setsockopt(SO_REUSEADDR): %d", MG_SOCK_ERR(rc)));
 #endif
+#if defined(SO_REUSEPORT) && !defined(SO_EXCLUSIVEADDRUSE)
+    } else if (c->mgr->reuseport &&
+               (rc = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (char *) &on,
+                                sizeof(on))) != 0) {
+      // Several managers listen on the same port, the kernel spreads
+      // accepted connections between them
+      MG_ERROR(("setsockopt(SO_REUSEPORT): %d", MG_SOCK_ERR(rc)));
+#endif
 #if MG_IPV6_V6ONLY
       // Bind only to the V6 address, not V4 address on this port
     } else if (c->loc.is_ip6 &&
@@ -9008,7 +9084,7 @@ static bool ioalloc(struct mg_connection *c, struct mg_iobuf *io) {
   if (io->len >= MG_MAX_RECV_SIZE) {
     mg_error(c, "MG_MAX_RECV_SIZE");
   } else if (io->size <= io->len &&
-             !mg_iobuf_resize(io, io->size + MG_IO_SIZE)) {
+             !mg_iobuf_resize(io, mg_iobuf_grow_size(io, io->size + MG_IO_SIZE))) {
     mg_error(c, "OOM");
   } else {
     res = true;
@@ -9502,7 +9578,7 @@ void mg_mgr_poll(struct mg_mgr *mgr, int ms) {
 
 #if MG_ENABLE_SSI
 static char *mg_ssi(const char *path, const char *root, int depth) {
-  struct mg_iobuf b = {NULL, 0, 0, MG_IO_SIZE};
+  struct mg_iobuf b = {NULL, 0, 0, MG_IO_SIZE, false};
   FILE *fp = fopen(path, "rb");
   if (fp != NULL) {
     char buf[MG_SSI_BUFSIZ], arg[sizeof(buf)];
@@ -11040,6 +11116,7 @@ struct tls_data {
   struct mg_str cert_der;  // certificate in DER format
   struct mg_str ca_der;    // CA certificate
   uint8_t ec_key[32];      // EC private key
+  int is_shared;           // cert_der and ca_der borrowed from mg_tls_shared
   char hostname[254];      // server hostname (client extension)
 
   int is_ec_pubkey;          // EC or RSA?
@@ -12578,8 +12655,70 @@ static int mg_parse_pem(const struct mg_str pem, const struct mg_str label,
   return 0;
 }
 
-void mg_tls_init(struct mg_connection *c, const struct mg_tls_opts *opts) {
+// Parsed server key material, shared by all accepted connections
+struct mg_tls_shared {
+  struct mg_str cert_der;
+  struct mg_str ca_der;
+  uint8_t ec_key[32];
+};
+
+static int mg_tls_parse_ec_key(struct mg_str pem, uint8_t ec_key[32]) {
   struct mg_str key;
+  if (mg_parse_pem(pem, mg_str_s("EC PRIVATE KEY"), &key) == 0) {
+    if (key.len < 39) {
+      MG_ERROR(("EC private key too short"));
+      mg_free((void *) key.buf);
+      return -1;
+    }
+    // expect ASN.1 SEQUENCE=[INTEGER=1, BITSTRING of 32 bytes, ...]
+    // 30 nn 02 01 01 04 20 [key] ...
+    if (key.buf[0] != 0x30 || (key.buf[1] & 0x80) != 0) {
+      MG_ERROR(("EC private key: ASN.1 bad sequence"));
+      mg_free((void *) key.buf);
+      return -1;
+    }
+    if (memcmp(key.buf + 2, "\x02\x01\x01\x04\x20", 5) != 0) {
+      MG_ERROR(("EC private key: ASN.1 bad data"));
+    }
+    memmove(ec_key, key.buf + 7, 32);
+    mg_free((void *) key.buf);
+    return 0;
+  } else if (mg_parse_pem(pem, mg_str_s("PRIVATE KEY"), &key) == 0) {
+    mg_free((void *) key.buf);
+    return -2;
+  }
+  return -3;
+}
+
+void *mg_tls_shared_new(const struct mg_tls_opts *opts) {
+  struct mg_tls_shared *sh =
+      (struct mg_tls_shared *) mg_calloc(1, sizeof(*sh));
+  if (sh == NULL) return NULL;
+  if (opts->ca.len > 0 &&
+      mg_parse_pem(opts->ca, mg_str_s("CERTIFICATE"), &sh->ca_der) < 0) {
+    goto fail;
+  }
+  if (opts->cert.buf == NULL || opts->key.buf == NULL ||
+      mg_parse_pem(opts->cert, mg_str_s("CERTIFICATE"), &sh->cert_der) < 0 ||
+      mg_tls_parse_ec_key(opts->key, sh->ec_key) != 0) {
+    goto fail;
+  }
+  return sh;
+fail:
+  MG_ERROR(("Shared TLS context init failed"));
+  mg_tls_shared_free(sh);
+  return NULL;
+}
+
+void mg_tls_shared_free(void *shared) {
+  struct mg_tls_shared *sh = (struct mg_tls_shared *) shared;
+  if (sh == NULL) return;
+  mg_free((void *) sh->cert_der.buf);
+  mg_free((void *) sh->ca_der.buf);
+  mg_free(sh);
+}
+
+void mg_tls_init(struct mg_connection *c, const struct mg_tls_opts *opts) {
   struct tls_data *tls =
       (struct tls_data *) mg_calloc(1, sizeof(struct tls_data));
   if (tls == NULL) {
@@ -12597,6 +12736,15 @@ void mg_tls_init(struct mg_connection *c, const struct mg_tls_opts *opts) {
   c->is_tls = c->is_tls_hs = 1;
   mg_sha256_init(&tls->sha256);
 
+  if (opts->shared != NULL && !c->is_client) {
+    struct mg_tls_shared *sh = (struct mg_tls_shared *) opts->shared;
+    tls->cert_der = sh->cert_der;
+    tls->ca_der = sh->ca_der;
+    memcpy(tls->ec_key, sh->ec_key, sizeof(tls->ec_key));
+    tls->is_shared = 1;
+    return;
+  }
+
   // save hostname (client extension)
   if (opts->name.len > 0) {
     if (opts->name.len >= sizeof(tls->hostname) - 1) {
@@ -12631,26 +12779,16 @@ void mg_tls_init(struct mg_connection *c, const struct mg_tls_opts *opts) {
     return;
   }
 
-  if (mg_parse_pem(opts->key, mg_str_s("EC PRIVATE KEY"), &key) == 0) {
-    if (key.len < 39) {
-      MG_ERROR(("EC private key too short"));
-      return;
-    }
-    // expect ASN.1 SEQUENCE=[INTEGER=1, BITSTRING of 32 bytes, ...]
-    // 30 nn 02 01 01 04 20 [key] ...
-    if (key.buf[0] != 0x30 || (key.buf[1] & 0x80) != 0) {
-      MG_ERROR(("EC private key: ASN.1 bad sequence"));
-      return;
-    }
-    if (memcmp(key.buf + 2, "\x02\x01\x01\x04\x20", 5) != 0) {
-      MG_ERROR(("EC private key: ASN.1 bad data"));
-    }
-    memmove(tls->ec_key, key.buf + 7, 32);
-    mg_free((void *) key.buf);
-  } else if (mg_parse_pem(opts->key, mg_str_s("PRIVATE KEY"), &key) == 0) {
-    mg_error(c, "PKCS8 private key format is not supported");
-  } else {
-    mg_error(c, "Expected EC PRIVATE KEY or PRIVATE KEY");
+  switch (mg_tls_parse_ec_key(opts->key, tls->ec_key)) {
+    case 0:
+    case -1:
+      break;
+    case -2:
+      mg_error(c, "PKCS8 private key format is not supported");
+      break;
+    default:
+      mg_error(c, "Expected EC PRIVATE KEY or PRIVATE KEY");
+      break;
   }
 }
 
@@ -12658,8 +12796,10 @@ void mg_tls_free(struct mg_connection *c) {
   struct tls_data *tls = (struct tls_data *) c->tls;
   if (tls != NULL) {
     mg_iobuf_free(&tls->send);
-    mg_free((void *) tls->cert_der.buf);
-    mg_free((void *) tls->ca_der.buf);
+    if (!tls->is_shared) {
+      mg_free((void *) tls->cert_der.buf);
+      mg_free((void *) tls->ca_der.buf);
+    }
   }
   mg_free(c->tls);
   c->tls = NULL;
@@ -14119,6 +14259,13 @@ void mg_tls_ctx_init(struct mg_mgr *mgr) {
 void mg_tls_ctx_free(struct mg_mgr *mgr) {
   (void) mgr;
 }
+void *mg_tls_shared_new(const struct mg_tls_opts *opts) {
+  (void) opts;
+  return NULL;
+}
+void mg_tls_shared_free(void *shared) {
+  (void) shared;
+}
 #endif
 
 #ifdef MG_ENABLE_LINES
@@ -14381,6 +14528,16 @@ void mg_tls_ctx_free(struct mg_mgr *mgr) {
     mgr->tls_ctx = NULL;
   }
 }
+
+// Not supported, callers fall back to per-connection mg_tls_init() parsing
+void *mg_tls_shared_new(const struct mg_tls_opts *opts) {
+  (void) opts;
+  return NULL;
+}
+
+void mg_tls_shared_free(void *shared) {
+  (void) shared;
+}
 #endif
 
 #ifdef MG_ENABLE_LINES
@@ -14497,22 +14654,137 @@ static void ssl_keylog_cb(const SSL *ssl, const char *line) {
 }
 #endif
 
+// Server context shared by all accepted connections: SSL_CTX holds the
+// parsed certificate chain and key, so SSL_new() inherits them for free
+struct mg_tls_shared {
+  SSL_CTX *ctx;
+  BIO_METHOD *bm;
+};
+
+static BIO_METHOD *mg_bio_meth_new(void) {
+  BIO_METHOD *bm;
+#if MG_TLS == MG_TLS_WOLFSSL
+  bm = BIO_meth_new(0, "bio_mg");
+#else
+  bm = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "bio_mg");
+#endif
+  BIO_meth_set_write(bm, mg_bio_write);
+  BIO_meth_set_read(bm, mg_bio_read);
+  BIO_meth_set_ctrl(bm, mg_bio_ctrl);
+  return bm;
+}
+
 void mg_tls_free(struct mg_connection *c) {
   struct mg_tls *tls = (struct mg_tls *) c->tls;
   if (tls == NULL) return;
   SSL_free(tls->ssl);
   SSL_CTX_free(tls->ctx);
-  BIO_meth_free(tls->bm);
+  if (!tls->is_shared) BIO_meth_free(tls->bm);
   mg_free(tls);
   c->tls = NULL;
 }
 
-void mg_tls_init(struct mg_connection *c, const struct mg_tls_opts *opts) {
+void *mg_tls_shared_new(const struct mg_tls_opts *opts) {
+  struct mg_tls_shared *sh =
+      (struct mg_tls_shared *) mg_calloc(1, sizeof(*sh));
+  const char *id = "mongoose";
+  int rc = 1;
+  if (sh == NULL) return NULL;
+  SSL_library_init();
+  if ((sh->ctx = SSL_CTX_new(TLS_server_method())) == NULL) goto fail;
+#ifdef MG_TLS_SSLKEYLOGFILE
+  SSL_CTX_set_keylog_callback(sh->ctx, ssl_keylog_cb);
+#endif
+  SSL_CTX_set_session_id_context(sh->ctx, (const uint8_t *) id,
+                                 (unsigned) strlen(id));
+  SSL_CTX_set_options(sh->ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 |
+                                   SSL_OP_NO_TLSv1 | SSL_OP_NO_TLSv1_1);
+#ifdef MG_ENABLE_OPENSSL_NO_COMPRESSION
+  SSL_CTX_set_options(sh->ctx, SSL_OP_NO_COMPRESSION);
+#endif
+#ifdef MG_ENABLE_OPENSSL_CIPHER_SERVER_PREFERENCE
+  SSL_CTX_set_options(sh->ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+#endif
+  if (opts->ca.buf != NULL && opts->ca.buf[0] != '\0') {
+    STACK_OF(X509_INFO) *certs = load_ca_certs(opts->ca);
+    SSL_CTX_set_verify(sh->ctx,
+                       SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+    rc = add_ca_certs(sh->ctx, certs);
+    sk_X509_INFO_pop_free(certs, X509_INFO_free);
+    if (!rc) goto fail;
+  }
+  if (opts->cert.buf != NULL && opts->cert.buf[0] != '\0') {
+    X509 *cert = load_cert(opts->cert);
+    rc = cert == NULL ? 0 : SSL_CTX_use_certificate(sh->ctx, cert);
+    X509_free(cert);
+    if (rc != 1) goto fail;
+  }
+  if (opts->key.buf != NULL && opts->key.buf[0] != '\0') {
+    EVP_PKEY *key = load_key(opts->key);
+    rc = key == NULL ? 0 : SSL_CTX_use_PrivateKey(sh->ctx, key);
+    EVP_PKEY_free(key);
+    if (rc != 1) goto fail;
+  }
+  SSL_CTX_set_mode(sh->ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#if MG_TLS == MG_TLS_OPENSSL && OPENSSL_VERSION_NUMBER > 0x10002000L
+  (void) SSL_CTX_set_ecdh_auto(sh->ctx, 1);
+#endif
+  if ((sh->bm = mg_bio_meth_new()) == NULL) goto fail;
+  MG_DEBUG(("Shared TLS context ready"));
+  return sh;
+fail:
+  MG_ERROR(("Shared TLS context init failed"));
+  ERR_clear_error();
+  mg_tls_shared_free(sh);
+  return NULL;
+}
+
+void mg_tls_shared_free(void *shared) {
+  struct mg_tls_shared *sh = (struct mg_tls_shared *) shared;
+  if (sh == NULL) return;
+  SSL_CTX_free(sh->ctx);  // Refcounted, live connections keep their copy
+  BIO_meth_free(sh->bm);
+  mg_free(sh);
+}
+
+static void mg_tls_init_shared(struct mg_connection *c,
+                               const struct mg_tls_opts *opts) {
+  struct mg_tls_shared *sh = (struct mg_tls_shared *) opts->shared;
   struct mg_tls *tls = (struct mg_tls *) mg_calloc(1, sizeof(*tls));
+  BIO *bio = NULL;
+  c->tls = tls;
+  if (tls == NULL) {
+    mg_error(c, "TLS OOM");
+    return;
+  }
+  SSL_CTX_up_ref(sh->ctx);
+  tls->ctx = sh->ctx;
+  tls->bm = sh->bm;
+  tls->is_shared = 1;
+  if ((tls->ssl = SSL_new(tls->ctx)) == NULL ||
+      (bio = BIO_new(tls->bm)) == NULL) {
+    mg_error(c, "SSL_new");
+    mg_tls_free(c);
+    return;
+  }
+  BIO_set_data(bio, c);
+  SSL_set_bio(tls->ssl, bio, bio);
+  c->is_tls = 1;
+  c->is_tls_hs = 1;
+  MG_DEBUG(("%lu SSL shared %s OK", c->id, c->is_accepted ? "accept" : "client"));
+}
+
+void mg_tls_init(struct mg_connection *c, const struct mg_tls_opts *opts) {
+  struct mg_tls *tls;
   const char *id = "mongoose";
   static unsigned char s_initialised = 0;
   BIO *bio = NULL;
   int rc;
+  if (opts->shared != NULL && !c->is_client) {
+    mg_tls_init_shared(c, opts);
+    return;
+  }
+  tls = (struct mg_tls *) mg_calloc(1, sizeof(*tls));
   c->tls = tls;
   if (tls == NULL) {
     mg_error(c, "TLS OOM");
@@ -14604,14 +14876,7 @@ void mg_tls_init(struct mg_connection *c, const struct mg_tls_opts *opts) {
     mg_free(s);
   }
 #endif
-#if MG_TLS == MG_TLS_WOLFSSL
-  tls->bm = BIO_meth_new(0, "bio_mg");
-#else
-  tls->bm = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "bio_mg");
-#endif
-  BIO_meth_set_write(tls->bm, mg_bio_write);
-  BIO_meth_set_read(tls->bm, mg_bio_read);
-  BIO_meth_set_ctrl(tls->bm, mg_bio_ctrl);
+  tls->bm = mg_bio_meth_new();
 
   bio = BIO_new(tls->bm);
   BIO_set_data(bio, c);
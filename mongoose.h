@@ -1482,12 +1482,21 @@ struct mg_iobuf {
   size_t size;         // Total size available
   size_t len;          // Current number of bytes
   size_t align;        // Alignment during allocation
+  bool geometric;      // Appends grow capacity by doubling, never shrink
+};
+
+// Per-thread counters of mg_iobuf_resize() work, for profiling
+struct mg_iobuf_stats {
+  size_t allocs;  // Buffer (re)allocations
+  size_t copied;  // Bytes moved from old into new allocations
 };
 
 int mg_iobuf_init(struct mg_iobuf *, size_t, size_t);
 int mg_iobuf_resize(struct mg_iobuf *, size_t);
 void mg_iobuf_free(struct mg_iobuf *);
+struct mg_iobuf_stats *mg_iobuf_stats(void);
 size_t mg_iobuf_add(struct mg_iobuf *, size_t, const void *, size_t);
+size_t mg_iobuf_grow_size(struct mg_iobuf *, size_t need);
 size_t mg_iobuf_del(struct mg_iobuf *, size_t ofs, size_t len);
 
 
@@ -1543,6 +1552,11 @@ void mg_sha256_init(mg_sha256_ctx *);
 void mg_sha256_update(mg_sha256_ctx *, const unsigned char *data, size_t len);
 void mg_sha256_final(unsigned char digest[32], mg_sha256_ctx *);
 void mg_sha256(uint8_t dst[32], uint8_t *data, size_t datasz);
+// Replaces the compression function run over whole 64-byte blocks, e.g.
+// with one using CPU SHA extensions. NULL restores the built-in one
+typedef void (*mg_sha256_blocks_fn)(uint32_t state[8],
+                                    const unsigned char *data, size_t blocks);
+void mg_sha256_set_blocks(mg_sha256_blocks_fn fn);
 void mg_hmac_sha256(uint8_t dst[32], uint8_t *key, size_t keysz, uint8_t *data,
                     size_t datasz);
 
@@ -1626,6 +1640,7 @@ struct mg_mgr {
   struct mg_tcpip_if *ifp;      // Builtin TCP/IP stack only. Interface pointer
   size_t extraconnsize;         // Builtin TCP/IP stack only. Extra space
   MG_SOCKET_TYPE pipe;          // Socketpair end for mg_wakeup()
+  bool reuseport;               // Listeners set SO_REUSEPORT, where available
 #if MG_ENABLE_FREERTOS_TCP
   SocketSet_t ss;  // NOTE(lsm): referenced from socket struct
 #endif
@@ -1790,9 +1805,13 @@ struct mg_tls_opts {
   struct mg_str key;      // PEM or DER
   struct mg_str name;     // If not empty, enable host name verification
   int skip_verification;  // Skip certificate and host name verification
+  void *shared;           // If set, mg_tls_shared_new() context, ca/cert/key
+                          // are ignored and taken from the shared context
 };
 
 void mg_tls_init(struct mg_connection *, const struct mg_tls_opts *opts);
+void *mg_tls_shared_new(const struct mg_tls_opts *opts);  // Server side, once
+void mg_tls_shared_free(void *shared);
 void mg_tls_free(struct mg_connection *);
 long mg_tls_send(struct mg_connection *, const void *buf, size_t len);
 long mg_tls_recv(struct mg_connection *, void *buf, size_t len);
@@ -2707,6 +2726,7 @@ struct mg_tls {
   BIO_METHOD *bm;
   SSL_CTX *ctx;
   SSL *ssl;
+  int is_shared;  // ctx and bm are borrowed from mg_tls_shared_new()
 };
 #endif
 
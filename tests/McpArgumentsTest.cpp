@@ -0,0 +1,221 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Calls a tool registered through the std::map overload of AddTool() with
+// object and array arguments over HTTP. Build and run from the repository
+// root:
+//   gcc -c mongoose.c -o mongoose.o
+//   g++ -std=c++20 -pthread -I. -Iinclude tests/McpArgumentsTest.cpp McpServer.cpp McpPoll.cpp McpJsonWriter.cpp McpTokenCache.cpp McpJwt.cpp McpBase64.cpp McpSha256.cpp mongoose.o -lssl -lcrypto -o McpArgumentsTest
+//   ./McpArgumentsTest
+
+#include "McpServer.h"
+#include "mongoose.h"
+#include "platform.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+static const char* URL = "http://127.0.0.1:18431/mcp";
+
+std::string CreateSessionId()
+{
+	static int next = 0;
+	return "session-" + std::to_string(++next);
+}
+
+struct Response {
+	bool done;
+	int status;
+	std::string session_id;
+	std::string body;
+};
+
+struct Request {
+	std::string session_id;
+	std::string body;
+	Response response;
+};
+
+static void cbClient(struct mg_connection* conn, int ev, void* ev_data)
+{
+	Request* request = (Request*)conn->fn_data;
+	if (ev == MG_EV_CONNECT)
+	{
+		mg_printf(conn,
+			"POST /mcp HTTP/1.1\r\n"
+			"Host: 127.0.0.1\r\n"
+			"Content-Type: application/json\r\n"
+			"Accept: application/json, text/event-stream\r\n"
+			"%s%s%s"
+			"Content-Length: %lu\r\n"
+			"\r\n"
+			"%s",
+			request->session_id.empty() ? "" : "Mcp-Session-Id: ",
+			request->session_id.c_str(),
+			request->session_id.empty() ? "" : "\r\n",
+			(unsigned long)request->body.size(),
+			request->body.c_str());
+	}
+	else if (ev == MG_EV_HTTP_MSG)
+	{
+		struct mg_http_message* hm = (struct mg_http_message*)ev_data;
+		struct mg_str* session_id = mg_http_get_header(hm, "Mcp-Session-Id");
+		request->response.status = mg_http_status(hm);
+		if (session_id != nullptr)
+		{
+			request->response.session_id.assign(session_id->buf, session_id->len);
+		}
+		request->response.body.assign(hm->body.buf, hm->body.len);
+		request->response.done = true;
+		conn->is_draining = 1;
+	}
+	else if (ev == MG_EV_ERROR || ev == MG_EV_CLOSE)
+	{
+		request->response.done = true;
+	}
+}
+
+static Response Post(const std::string& session_id, const std::string& body)
+{
+	struct mg_mgr mgr;
+	mg_mgr_init(&mgr);
+	Request request = { session_id, body, { false, 0, "", "" } };
+	uint64_t deadline = mg_millis() + 5000;
+	// The server starts on another thread; retry until it listens
+	while (!request.response.done || request.response.status == 0)
+	{
+		if (mg_millis() > deadline)
+		{
+			break;
+		}
+		if (request.response.done)
+		{
+			request.response.done = false;
+			mg_mgr_poll(&mgr, 100);
+		}
+		mg_http_connect(&mgr, URL, cbClient, &request);
+		while (!request.response.done && mg_millis() < deadline)
+		{
+			mg_mgr_poll(&mgr, 50);
+		}
+	}
+	mg_mgr_free(&mgr);
+	return request.response;
+}
+
+// The JSON-RPC message of a single event stream message
+static std::string Message(const std::string& body)
+{
+	size_t start = body.find("data: ");
+	if (start == std::string::npos)
+	{
+		return body;
+	}
+	start += 6;
+	return body.substr(start, body.find('\n', start) - start);
+}
+
+static int s_failures = 0;
+
+static void CheckText(const std::string& text, const std::string& expected, const char* what)
+{
+	if (text != expected)
+	{
+		printf("FAIL: %s\n  got      %s\n  expected %s\n", what, text.c_str(), expected.c_str());
+		s_failures++;
+	}
+}
+
+static void Check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAIL: %s\n", what);
+		s_failures++;
+	}
+}
+
+static std::string ToolText(const std::string& session_id, int id, const char* arguments)
+{
+	std::string body = "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id)
+		+ ",\"method\":\"tools/call\",\"params\":{\"name\":\"describe\",\"arguments\":" + arguments + "}}";
+	std::string message = Message(Post(session_id, body).body);
+	char* text = mg_json_get_str(mg_str_n(message.data(), message.size()), "$.result.content[0].text");
+	std::string result = text != nullptr ? text : "";
+	mg_free(text);
+	if (text == nullptr)
+	{
+		printf("unexpected reply: %s\n", message.c_str());
+	}
+	return result;
+}
+
+int main()
+{
+	mg_log_set(MG_LL_NONE);
+
+	McpServer server("MCP Test");
+	server.AddTool(
+		"describe",
+		"Echoes its arguments",
+		{
+			{ "options", McpServer::PROPERTY_OBJECT, "options", true },
+			{ "tags", McpServer::PROPERTY_ARRAY, "tags", false },
+			{ "count", McpServer::PROPERTY_INTEGER, "count", false }
+		},
+		{},
+		[](const std::map<std::string, std::string>& args) -> std::vector<McpServer::McpContent> {
+			// Arguments left out of the call map to empty strings
+			std::string text = args.at("options");
+			if (!args.at("tags").empty())
+			{
+				text += " " + args.at("tags");
+			}
+			if (!args.at("count").empty())
+			{
+				text += " " + args.at("count");
+			}
+			McpServer::McpContent content;
+			content.property_type = McpServer::PROPERTY_STRING;
+			content.value = text;
+			return { content };
+		}
+	);
+	std::thread([&server]() { server.Run(URL, 60 * 1000); }).detach();
+
+	Response init = Post("", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}");
+	Check(init.status == 200 && !init.session_id.empty(), "initialize");
+	std::string session_id = init.session_id;
+	Post(session_id, "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/initialized\"}");
+
+	CheckText(ToolText(session_id, 2, "{\"options\":{\"a\":1,\"b\":[true,null],\"c\":\"x\\\"y\"}}"),
+		"{\"a\":1,\"b\":[true,null],\"c\":\"x\\\"y\"}", "object argument reaches the map as its JSON text");
+	CheckText(ToolText(session_id, 3, "{\"options\":{},\"tags\":[ \"p\", {\"q\": [] } ],\"count\":7}"),
+		"{} [ \"p\", {\"q\": [] } ] 7", "array and scalar arguments reach the map as their JSON text");
+	CheckText(ToolText(session_id, 4, "{\"tags\":[[[[1]]],[[2]]],\"options\":{\"d\":{\"e\":{\"f\":{\"g\":\"\\u00e9\"}}}}}"),
+		"{\"d\":{\"e\":{\"f\":{\"g\":\"\\u00e9\"}}}} [[[[1]]],[[2]]]", "nested containers keep their text");
+
+	if (s_failures == 0)
+	{
+		printf("OK\n");
+	}
+	// Run() does not return; leave without stopping the server thread
+	fflush(stdout);
+	_Exit(s_failures == 0 ? 0 : 1);
+}
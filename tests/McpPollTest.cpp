@@ -0,0 +1,102 @@
+/*
+ *  Copyright (C) 2025 UmeSoftware LLC
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Regression test for McpPollTimeout(). Build and run from the repository
+// root:
+//   gcc -c mongoose.c -o mongoose.o
+//   g++ -std=c++20 -I. tests/McpPollTest.cpp McpPoll.cpp mongoose.o -o McpPollTest
+//   ./McpPollTest
+
+#include "McpPoll.h"
+#include "mongoose.h"
+
+#include <cstdio>
+
+static int s_failures = 0;
+
+static void Check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAIL: %s\n", what);
+		s_failures++;
+	}
+}
+
+static void cbTimer(void* arg)
+{
+	(*(int*)arg)++;
+}
+
+int main()
+{
+	struct mg_mgr mgr;
+	mg_mgr_init(&mgr);
+
+	Check(McpPollTimeout(&mgr, 1000) == 1000, "no timers: full poll interval");
+
+	// A one-shot timer the loop keeps listed after it fires, as the JWKS
+	// timer is until the server stops
+	int calls = 0;
+	struct mg_timer once;
+	mg_timer_init(&mgr.timers, &once, 20, 0, cbTimer, &calls);
+	// The first poll arms it
+	mg_mgr_poll(&mgr, 0);
+	int timeout = McpPollTimeout(&mgr, 1000);
+	Check(timeout > 0 && timeout <= 20, "pending one-shot timer bounds the poll");
+
+	uint64_t start = mg_millis();
+	while (calls == 0 && mg_millis() - start < 1000)
+	{
+		mg_mgr_poll(&mgr, McpPollTimeout(&mgr, 1000));
+	}
+	Check(calls == 1, "one-shot timer fired");
+	Check(McpPollTimeout(&mgr, 1000) == 1000, "fired one-shot timer does not shorten the poll");
+
+	// The loop must block again instead of spinning on the fired timer
+	start = mg_millis();
+	int polls = 0;
+	while (mg_millis() - start < 200)
+	{
+		mg_mgr_poll(&mgr, McpPollTimeout(&mgr, 50));
+		polls++;
+	}
+	Check(polls <= 6, "loop with a fired one-shot timer does not spin");
+	Check(calls == 1, "one-shot timer fired only once");
+
+	// A repeating timer still bounds the poll after each call
+	struct mg_timer repeat;
+	mg_timer_init(&mgr.timers, &repeat, 30, MG_TIMER_REPEAT, cbTimer, &calls);
+	start = mg_millis();
+	while (calls < 3 && mg_millis() - start < 1000)
+	{
+		mg_mgr_poll(&mgr, McpPollTimeout(&mgr, 1000));
+	}
+	Check(calls == 3, "repeating timer fired twice");
+	timeout = McpPollTimeout(&mgr, 1000);
+	Check(timeout <= 30, "repeating timer bounds the poll after firing");
+
+	mg_timer_free(&mgr.timers, &repeat);
+	mg_timer_free(&mgr.timers, &once);
+	mg_mgr_free(&mgr);
+
+	if (s_failures == 0)
+	{
+		printf("OK\n");
+	}
+	return s_failures == 0 ? 0 : 1;
+}